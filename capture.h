@@ -0,0 +1,220 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+
+#define GLEW_STATIC
+#include <glew.h>
+
+#include "readback.h"
+
+// what the capture reads back
+#define CAPTURE_TRAIL 0 // the RGBA32F trail map at the map size
+#define CAPTURE_FRAME 1 // the RGBA8 composed frame at the framebuffer size
+
+// the states of a capture buffer
+enum capture_slot_state {
+    CAPTURE_SLOT_FREE, // ready to capture into
+    CAPTURE_SLOT_PENDING, // the read is in flight behind the fence
+    CAPTURE_SLOT_LEASED // handed to the sink, waiting for it to release the frame
+};
+
+/*
+    CaptureFrame struct (default public class)
+
+    description:
+        a captured frame handed to a sink
+        the pixels point straight into a persistently mapped pixel buffer, nothing was copied
+        the frame is a lease on that buffer, the sink must call release once it is done with the pixels
+        (from any thread), and the buffer isn't reused for another capture until then
+
+    member variables:
+        pixels, bytes
+        width, height
+        is_float
+        index, step
+        lease
+*/
+struct CaptureFrame {
+    const void* pixels; // the pixels, bottom row first, 4 channels per pixel
+    size_t bytes; // the number of bytes of pixels
+    int width;
+    int height;
+    bool is_float; // true for 32 bit float channels, false for 8 bit channels
+    long long index; // the capture number, frames are handed to the sink in this order
+    uint64_t step; // the simulation step the frame was captured at
+
+    std::atomic<int>* lease; // the state of the slot holding the pixels
+
+    void release() const;
+};
+
+/*
+    FrameSink struct (default public class)
+
+    description:
+        the interface for whatever the captured frames go to
+        consume is called on the gl thread in capture order, it should return quickly
+        a sink that keeps frames (to work on another thread) must release every one of them eventually,
+        and its destructor must not return before every frame it was given has been released
+*/
+struct FrameSink {
+    virtual ~FrameSink() {}
+    virtual void consume(const CaptureFrame& frame) = 0;
+};
+
+/*
+    FrameCapture class
+
+    description:
+        reads frames back through a small rotation of pixel buffer objects
+        a capture only queues the read into a free buffer and places a fence behind it, so run() never waits on it
+        a frame or two later poll sees the fence has signaled and hands the still mapped pixels to the sink
+        if every buffer is still queued or held by the sink, the capture is dropped and counted
+
+    member variables:
+        source
+        slots, slot_count
+        pending
+        captured, dropped
+*/
+class FrameCapture {
+    private:
+        struct slot {
+            std::atomic<int> state{ CAPTURE_SLOT_FREE };
+            GLsync fence = 0;
+            ReadbackBuffer buffer;
+            CaptureFrame frame;
+        };
+
+        static const int max_slots = 3;
+
+        int source; // CAPTURE_TRAIL or CAPTURE_FRAME
+        slot slots[max_slots];
+        int slot_count; // the number of slots in rotation, 2 or 3
+        std::deque<slot*> pending; // slots waiting on their fence, oldest first
+
+        long long captured = 0; // the number of frames captured so far
+        long long dropped = 0; // the number of frames dropped because no buffer was free
+
+    public:
+        FrameCapture(int capture_source, int buffers) : source(capture_source) {
+            slot_count = buffers < 2 ? 2 : (buffers > max_slots ? max_slots : buffers);
+        }
+
+        /*
+            FrameCapture destructor
+
+            description:
+                the sink has to be finished (and have released every frame) before this runs,
+                the buffers are unmapped here and this has to run on the gl thread
+        */
+        ~FrameCapture() {
+            for (int i = 0; i < slot_count; i++) {
+                if (slots[i].fence)
+                    glDeleteSync(slots[i].fence);
+                slots[i].buffer.release();
+            }
+        }
+
+        /*
+            capture function
+
+            takes in the trail texture, the size of the map and the current step
+            returns true if the read was queued, false if the frame was dropped
+
+            description:
+                for CAPTURE_FRAME this has to run after the frame is drawn and before the buffers are swapped
+        */
+        bool capture(GLuint trail_texture, int map_width, int map_height, uint64_t step) {
+            slot* free_slot = NULL;
+            for (int i = 0; i < slot_count && free_slot == NULL; i++) {
+                if (slots[i].state == CAPTURE_SLOT_FREE)
+                    free_slot = &slots[i];
+            }
+            if (free_slot == NULL) {
+                dropped++;
+                return false;
+            }
+
+            // the composed frame is only the part of the framebuffer the map is drawn into, without the letterbox bars
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+
+            CaptureFrame& frame = free_slot->frame;
+            frame.is_float = source == CAPTURE_TRAIL;
+            if (source == CAPTURE_TRAIL) {
+                frame.width = map_width;
+                frame.height = map_height;
+                frame.bytes = (size_t)map_width * map_height * 4 * sizeof(float);
+            } else {
+                frame.width = viewport[2];
+                frame.height = viewport[3];
+                frame.bytes = (size_t)frame.width * frame.height * 4;
+            }
+            free_slot->buffer.reserve(frame.bytes);
+            frame.pixels = free_slot->buffer.mapped;
+            frame.index = captured++;
+            frame.step = step;
+            frame.lease = &free_slot->state;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, free_slot->buffer.buffer);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            if (source == CAPTURE_TRAIL) {
+                glGetTextureImage(trail_texture, 0, GL_RGBA, GL_FLOAT, (GLsizei)frame.bytes, (void*)0);
+            } else {
+                glReadBuffer(GL_BACK);
+                glReadPixels(viewport[0], viewport[1], frame.width, frame.height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            // the fence is polled without flushing, so it is flushed here or it may never reach the gpu
+            free_slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            free_slot->state = CAPTURE_SLOT_PENDING;
+            pending.push_back(free_slot);
+            return true;
+        }
+
+        /*
+            poll function
+
+            takes in the sink the frames go to
+            takes in whether to wait for the reads still in flight, used when shutting down
+
+            description:
+                hands every frame whose fence has signaled to the sink, in capture order
+        */
+        void poll(FrameSink* sink, bool wait = false) {
+            while (!pending.empty()) {
+                slot* oldest = pending.front();
+                if (wait)
+                    glClientWaitSync(oldest->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+                else if (!fence_signaled(oldest->fence))
+                    return;
+
+                glDeleteSync(oldest->fence);
+                oldest->fence = 0;
+                pending.pop_front();
+
+                oldest->state = CAPTURE_SLOT_LEASED;
+                if (sink)
+                    sink->consume(oldest->frame);
+                else
+                    oldest->frame.release();
+            }
+        }
+
+        long long captured_count() const {
+            return captured;
+        }
+        long long dropped_count() const {
+            return dropped;
+        }
+};
+
+inline void CaptureFrame::release() const {
+    lease->store(CAPTURE_SLOT_FREE);
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define GLEW_STATIC
+#include <glew.h>
+
+#include "readback.h"
+#include "snapshot.h"
+
+/*
+    Checkpointer class
+
+    description:
+        takes snapshots without stalling the step loop
+        a checkpoint starts with gpu side copies only: the agent buffer is copied with glCopyNamedBufferSubData
+        and the trail map is read into a pixel pack buffer, both landing in persistently mapped staging buffers
+        a fence marks the end of the copies, and once it signals the slot is handed to a writer thread
+        which checksums and writes the snapshot straight from the mappings
+
+        there are a few slots in a ring, if every slot is still busy the checkpoint is skipped instead of waiting
+        by default the slots are written as plain snapshots, but any writer can be handed in, the series recorder uses this
+
+    member variables:
+        name, write
+        slots
+        queue, queue_lock, queue_signal
+        writer
+        stopping
+*/
+// writes one checkpoint from the mapped staging buffers, returns true if it was written
+typedef std::function<bool(const snapshot_header& header, const void* settings, const void* agents, const void* trail)> checkpoint_writer;
+
+class Checkpointer {
+    private:
+        enum slot_state {
+            SLOT_FREE, // ready to take a checkpoint
+            SLOT_COPYING, // the gpu copies are in flight, only the gl thread touches the slot
+            SLOT_WRITING // owned by the writer thread until it is written
+        };
+
+        struct slot {
+            std::atomic<int> state{ SLOT_FREE };
+            GLsync fence = 0;
+
+            ReadbackBuffer agents; // staging copy of the agent buffer
+            ReadbackBuffer trail; // staging copy of the trail map
+            snapshot_header header; // the sizes and random number state at the time of the copy
+            std::vector<unsigned char> settings; // a copy of the settings block
+        };
+
+        static const int slot_count = 2;
+
+        std::string name; // what the messages call a checkpoint
+        checkpoint_writer write;
+        slot slots[slot_count];
+
+        // slots waiting for the writer thread
+        std::deque<slot*> queue;
+        std::mutex queue_lock;
+        std::condition_variable queue_signal;
+        std::thread writer;
+        bool stopping = false;
+
+        /*
+            write_loop function
+
+            description:
+                the writer thread, writes every slot that shows up in the queue and frees it again
+        */
+        void write_loop() {
+            while (true) {
+                slot* current;
+                {
+                    std::unique_lock<std::mutex> lock(queue_lock);
+                    queue_signal.wait(lock, [this] { return stopping || !queue.empty(); });
+                    if (queue.empty())
+                        return;
+                    current = queue.front();
+                    queue.pop_front();
+                }
+
+                write(current->header, current->settings.data(), current->agents.mapped, current->trail.mapped);
+                current->state = SLOT_FREE;
+            }
+        }
+
+    public:
+        /*
+            Checkpointer contructor
+
+            takes in what to call a checkpoint in messages and the function that writes one
+
+            description:
+                the function runs on the writer thread
+        */
+        Checkpointer(const std::string& checkpoint_name, checkpoint_writer checkpoint_write) :
+            name(checkpoint_name), write(checkpoint_write) {
+            writer = std::thread(&Checkpointer::write_loop, this);
+        }
+
+        /*
+            Checkpointer contructor
+
+            takes in the path every checkpoint is saved to as a plain snapshot
+        */
+        Checkpointer(const std::string& path) :
+            Checkpointer("checkpoint", [path](const snapshot_header& header, const void* settings, const void* agents, const void* trail) {
+                bool saved = write_snapshot(path, header, settings, agents, trail);
+                if (saved)
+                    fprintf(stderr, "saved a snapshot of step %llu to %s\n", (unsigned long long)header.step, path.c_str());
+                return saved;
+            }) {}
+
+        /*
+            Checkpointer destructor
+
+            description:
+                finishes every checkpoint that was started, then stops the writer thread and releases the staging buffers
+                this has to run on the gl thread while the context is still current
+        */
+        ~Checkpointer() {
+            for (int i = 0; i < slot_count; i++) {
+                if (slots[i].state == SLOT_COPYING) {
+                    glClientWaitSync(slots[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+                }
+            }
+            poll();
+
+            {
+                std::lock_guard<std::mutex> lock(queue_lock);
+                stopping = true;
+            }
+            queue_signal.notify_one();
+            writer.join();
+
+            for (int i = 0; i < slot_count; i++) {
+                slots[i].agents.release();
+                slots[i].trail.release();
+            }
+        }
+
+        /*
+            request function
+
+            takes in the agent buffer, the trail texture and what is needed for the snapshot header
+            returns true if the checkpoint was started, false if every slot was still busy
+
+            description:
+                only queues gpu commands, nothing here waits on the gpu
+        */
+        bool request(GLuint agent_buffer, GLuint trail_texture, const void* settings, size_t settings_size,
+            int width, int height, int agent_count, uint32_t agent_size, uint64_t seed, uint64_t step) {
+            slot* free_slot = NULL;
+            for (int i = 0; i < slot_count && free_slot == NULL; i++) {
+                if (slots[i].state == SLOT_FREE)
+                    free_slot = &slots[i];
+            }
+            if (free_slot == NULL) {
+                fprintf(stderr, "Skipped the %s at step %llu, the last one is still being written.\n", name.c_str(), (unsigned long long)step);
+                return false;
+            }
+
+            free_slot->header = make_snapshot_header(width, height, agent_count, agent_size, (uint32_t)settings_size,
+                GL_RGBA32F, 4 * sizeof(float), seed, step);
+            free_slot->settings.assign((const unsigned char*)settings, (const unsigned char*)settings + settings_size);
+            free_slot->agents.reserve((size_t)free_slot->header.agents.size);
+            free_slot->trail.reserve((size_t)free_slot->header.trail.size);
+
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+            glCopyNamedBufferSubData(agent_buffer, free_slot->agents.buffer, 0, 0, (GLsizeiptr)free_slot->header.agents.size);
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, free_slot->trail.buffer);
+            glGetTextureImage(trail_texture, 0, GL_RGBA, GL_FLOAT, (GLsizei)free_slot->header.trail.size, (void*)0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            // the fence is polled without flushing, so it is flushed here or a checkpoint taken
+            // while paused would wait on it until something else flushed the queue
+            free_slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            free_slot->state = SLOT_COPYING;
+            return true;
+        }
+
+        /*
+            poll function
+
+            description:
+                hands every slot whose copies have finished to the writer thread, never blocks
+                called once per loop iteration on the gl thread
+        */
+        void poll() {
+            for (int i = 0; i < slot_count; i++) {
+                slot& current = slots[i];
+                if (current.state != SLOT_COPYING || !fence_signaled(current.fence))
+                    continue;
+
+                glDeleteSync(current.fence);
+                current.fence = 0;
+                current.state = SLOT_WRITING;
+                {
+                    std::lock_guard<std::mutex> lock(queue_lock);
+                    queue.push_back(&current);
+                }
+                queue_signal.notify_one();
+            }
+        }
+};
@@ -0,0 +1,648 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <json.hpp>
+
+#include "kernels.h"
+#include "parallel.h"
+#include "rng.h"
+#include "sat.h"
+#include "snapshot.h"
+#include "spawn.h"
+#include "species.h"
+#include "dishes.h"
+
+/*
+    cpu engine
+
+    description:
+        runs the simulation on the cpu with no window and no gl context, for headless runs and batches of runs
+        one step is the same as a step of the shaders with sparse_diffusion, lazy_decay, diffusion_substeps
+        and the sat, mip and blur sensing all off: the whole map is diffused and decayed, then every agent senses,
+        turns, moves and deposits
+        a footprint bigger than the unrolled ones is read from a summed area table built every step (see sat.h),
+        so away from the edges a sensor costs 4 reads, the sums only differ from the plain ones by the fixed point rounding
+
+        the engine is a template on the kernel options (see kernels.h), so every loop is compiled for one
+        boundary mode, one sensor footprint, one trail precision and with or without the agent map
+        and none of them branch on an option at run time, make_engine picks the instantiation once
+
+        the agents sense and move in parallel, reading the map as the diffusion left it
+        then they deposit one after another in id order, so a run is the same whatever the thread count
+        the gpu deposits in whatever order the invocations land, so the two only agree closely, not bit for bit
+*/
+
+// the trail section of a snapshot is always RGBA 32 bit floats, this is GL_RGBA32F without needing gl
+#define ENGINE_SNAPSHOT_FORMAT 0x8814
+
+// the same layout as simulation_settings in simulation.h, so the settings section of a snapshot is the same too
+struct engine_settings {
+    // agent settings
+    float move_speed;
+    float turn_speed;
+    float sensor_angle;
+    float sensor_distance;
+
+    // map size
+    int width;
+    int height;
+
+    // diffusion and decay settings
+    float r;
+    float g;
+    float b;
+    float decay_rate;
+    float diffuse_rate;
+
+    // random number generator key
+    unsigned int seed_lo;
+    unsigned int seed_hi;
+};
+
+// the same layout as the agent struct of the shaders
+struct engine_agent {
+    float x;
+    float y;
+    float angle;
+};
+
+/*
+    half conversion functions
+
+    description:
+        IEEE 754 binary16, the format of an rgba16f texture
+        float_to_half rounds to the nearest half, ties to even, the same as the gpu does when it stores one
+*/
+inline uint16_t float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+    if (magnitude >= 0x47800000u) // too big for a half, infinity or not a number
+        return (uint16_t)(sign | (magnitude > 0x7F800000u ? 0x7E00u : 0x7C00u));
+    if (magnitude < 0x38800000u) { // a subnormal half, in steps of 2^-24
+        float absolute;
+        memcpy(&absolute, &magnitude, sizeof(absolute));
+        return (uint16_t)(sign | (uint32_t)std::nearbyint(absolute * 16777216.0f));
+    }
+    // rebias the exponent and round the 13 bits that are dropped
+    magnitude += 0xC8000FFFu + ((magnitude >> 13) & 1u);
+    return (uint16_t)(sign | (magnitude >> 13));
+}
+inline float half_to_float(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+
+    uint32_t bits;
+    if (exponent == 0) {
+        float value = (float)mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    } else if (exponent == 31) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/*
+    trail storage policies
+
+    description:
+        how one channel of the trail map is stored, one for each TRAIL precision
+        the engine only ever goes through load and store, so the precision costs nothing where it isn't used
+*/
+struct trail_f32 {
+    typedef float channel;
+    static float load(channel value) { return value; }
+    static channel store(float value) { return value; }
+};
+struct trail_f16 {
+    typedef uint16_t channel;
+    static float load(channel value) { return half_to_float(value); }
+    static channel store(float value) { return float_to_half(value); }
+};
+struct trail_u16 {
+    typedef uint16_t channel;
+    static float load(channel value) { return value * (1.0f / 65535.0f); }
+    static channel store(float value) { return (channel)(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f); }
+};
+
+/*
+    Engine class
+
+    description:
+        what every instantiation of CpuEngine looks like from the outside
+        the only virtual call is once a step, everything under it is compiled for one set of kernel options
+*/
+class Engine {
+    public:
+        virtual ~Engine() {}
+
+        // advances the simulation by one step, clearing the agent map first if asked
+        virtual void step(bool clear_agents) = 0;
+        // fills width * height RGBA floats with the trail map, bottom row first
+        virtual void read_trail(float* rgba) const = 0;
+        // fills width * height RGBA floats with the agent map, all zero when the agents aren't drawn
+        virtual void read_agent_map(float* rgba) const = 0;
+
+        virtual const engine_settings& settings() const = 0;
+        virtual const std::vector<engine_agent>& agents() const = 0;
+        virtual uint64_t step_count() const = 0;
+        // changes how many threads the next steps are spread over, 0 for every core
+        virtual void set_threads(int count) = 0;
+        // starts over at step 0 with new settings and agents of the same map size and count, reusing every buffer
+        virtual void restart(const engine_settings& settings, const std::vector<engine_agent>& agents) = 0;
+
+        /*
+            save function
+
+            takes in the path to write the snapshot to and the seed of the run
+            returns true if the snapshot was written
+
+            description:
+                writes the same snapshot the gpu simulation does, so a cpu run can be resumed on the gpu and back
+        */
+        bool save(const std::string& path, uint64_t seed) const {
+            const engine_settings& run_settings = settings();
+            std::vector<float> trail((size_t)run_settings.width * run_settings.height * 4);
+            read_trail(trail.data());
+
+            snapshot_header header = make_snapshot_header(run_settings.width, run_settings.height, (int)agents().size(),
+                sizeof(engine_agent), sizeof(engine_settings), ENGINE_SNAPSHOT_FORMAT, 4 * sizeof(float), seed, step_count());
+            return write_snapshot(path, header, &run_settings, agents().data(), trail.data());
+        }
+};
+
+/*
+    CpuEngine class
+
+    description:
+        the simulation on the cpu, compiled for one boundary mode, sensor footprint, trail precision and agent map
+        SensorSize is 1, 3 or 5 for the footprints that get unrolled, or 0 to read the footprint at run time
+        from the summed area table
+
+    member variables:
+        run_settings, key, sensor_size, threads, pool, steps, pow2_map
+        agent_list
+        trail, scratch
+        agent_map
+        summed_area
+*/
+template <int Boundary, int SensorSize, typename Trail, bool DrawAgents>
+class CpuEngine : public Engine {
+    private:
+        typedef typename Trail::channel channel;
+
+        engine_settings run_settings;
+        philox_key key; // the seed, the same key the shaders get through the settings
+        int sensor_size; // only read when SensorSize is 0
+        int threads; // the number of threads the steps are spread over, 0 for every core
+        WorkerPool pool; // the threads, kept for the engine's whole life so a step doesn't start any
+        uint64_t steps = 0; // the number of steps taken, used as part of the random counter
+        bool pow2_map; // the map is a power of two both ways, so wrapping is a mask
+
+        std::vector<engine_agent> agent_list;
+        std::vector<channel> trail; // RGBA per pixel, bottom row first like the texture
+        std::vector<channel> scratch; // the diffusion writes here, then it is swapped with trail
+        std::vector<float> agent_map; // RGBA per pixel, empty when the agents aren't drawn
+        std::vector<uint32_t> summed_area; // the summed area table of trail, empty unless SensorSize is 0
+
+        // the pixel a pixel past the edge stands for, false when it holds no trail
+        bool boundary_pixel(int& x, int& y) const {
+            int width = run_settings.width;
+            int height = run_settings.height;
+            if (x >= 0 && y >= 0 && x < width && y < height)
+                return true;
+            if (Boundary == BOUNDARY_ZERO)
+                return false;
+            if (Boundary == BOUNDARY_WRAP && pow2_map) {
+                x &= width - 1;
+                y &= height - 1;
+            } else if (Boundary == BOUNDARY_WRAP) {
+                x = ((x % width) + width) % width;
+                y = ((y % height) + height) % height;
+            } else {
+                x = std::min(std::max(x, 0), width - 1);
+                y = std::min(std::max(y, 0), height - 1);
+            }
+            return true;
+        }
+
+        // a position past the edge wrapped around to the other side
+        float wrap_position(float position, int size) const {
+            float whole = std::floor(position);
+            float wrapped = pow2_map ? (float)((int)whole & (size - 1)) + (position - whole) : position - size * std::floor(position / size);
+            return wrapped >= size ? wrapped - size : wrapped;
+        }
+
+        // the sum of the four channels of a pixel inside the map, what a sensor sees
+        float sense_value(int x, int y) const {
+            const channel* pixel = &trail[((size_t)y * run_settings.width + x) * 4];
+            return Trail::load(pixel[0]) + Trail::load(pixel[1]) + Trail::load(pixel[2]) + Trail::load(pixel[3]);
+        }
+
+        /*
+            diffuse_row function
+
+            takes in the row to diffuse
+
+            description:
+                blurs, mixes and decays one row of trail into scratch, the same arithmetic as diffuse.glsl
+        */
+        void diffuse_row(int y) {
+            int width = run_settings.width;
+            int height = run_settings.height;
+            float decay_rate = run_settings.decay_rate;
+            float diffuse_weight = std::min(std::max(run_settings.diffuse_rate, 0.0f), 1.0f);
+            bool inside_row = y > 0 && y < height - 1;
+
+            for (int x = 0; x < width; x++) {
+                bool inside = inside_row && x > 0 && x < width - 1; // the whole 3x3 square is in the map
+                float blurred_color[4] = { 0, 0, 0, 0 };
+                for (int offset_x = -1; offset_x <= 1; offset_x++) {
+                    for (int offset_y = -1; offset_y <= 1; offset_y++) {
+                        int sample_x = x + offset_x;
+                        int sample_y = y + offset_y;
+                        if (!inside && !boundary_pixel(sample_x, sample_y))
+                            continue;
+
+                        const channel* sample = &trail[((size_t)sample_y * width + sample_x) * 4];
+                        for (int c = 0; c < 4; c++)
+                            blurred_color[c] += Trail::load(sample[c]);
+                    }
+                }
+
+                const channel* original = &trail[((size_t)y * width + x) * 4];
+                channel* out = &scratch[((size_t)y * width + x) * 4];
+                for (int c = 0; c < 4; c++) {
+                    float trail_color = Trail::load(original[c]) * (1 - diffuse_weight) + blurred_color[c] / 9 * diffuse_weight;
+                    trail_color = c == 3 ? 1.0f : trail_color - decay_rate;
+                    out[c] = Trail::store(std::max(trail_color, 0.0f));
+                }
+            }
+        }
+
+        /*
+            sense function
+
+            takes in an agent, the angle of the sensor from its heading and the sensor distance
+            returns the sum of the sense values in the sensor's footprint, the same as sense_trail in slime_mold.glsl
+        */
+        float sense(const engine_agent& a, float sensor_offset, float sensor_distance) const {
+            float sensor_angle = a.angle + sensor_offset;
+            int sensor_x = (int)(a.x + std::cos(sensor_angle) * sensor_distance);
+            int sensor_y = (int)(a.y + std::sin(sensor_angle) * sensor_distance);
+            const int radius = (SensorSize > 0 ? SensorSize : sensor_size) / 2;
+
+            // most footprints are inside the map, and those need no boundary handling at all
+            float sense_sum = 0;
+            if (sensor_x - radius >= 0 && sensor_y - radius >= 0 && sensor_x + radius < run_settings.width && sensor_y + radius < run_settings.height) {
+                if (SensorSize == 0)
+                    return summed_area_sum(summed_area.data(), run_settings.width, sensor_x - radius, sensor_y - radius, sensor_x + radius, sensor_y + radius);
+                for (int offset_x = -radius; offset_x <= radius; offset_x++) {
+                    for (int offset_y = -radius; offset_y <= radius; offset_y++)
+                        sense_sum += sense_value(sensor_x + offset_x, sensor_y + offset_y);
+                }
+                return sense_sum;
+            }
+
+            for (int offset_x = -radius; offset_x <= radius; offset_x++) {
+                for (int offset_y = -radius; offset_y <= radius; offset_y++) {
+                    int sample_x = sensor_x + offset_x;
+                    int sample_y = sensor_y + offset_y;
+                    if (boundary_pixel(sample_x, sample_y))
+                        sense_sum += sense_value(sample_x, sample_y);
+                }
+            }
+            return sense_sum;
+        }
+
+        /*
+            move_agent function
+
+            takes in the agent's id
+
+            description:
+                steers and moves one agent, the same as main in slime_mold.glsl up to the deposit
+        */
+        void move_agent(int id) {
+            engine_agent current_agent = agent_list[id];
+
+            uint32_t rand[4] = { (uint32_t)id, (uint32_t)steps, RNG_STREAM_AGENT, 0 };
+            philox4x32(rand, key);
+
+            float turn_speed = run_settings.turn_speed;
+            float sense_f = sense(current_agent, 0, run_settings.sensor_distance);
+            float sense_l = sense(current_agent, run_settings.sensor_angle, run_settings.sensor_distance);
+            float sense_r = sense(current_agent, -run_settings.sensor_angle, run_settings.sensor_distance);
+
+            float steer_strength = rng_unit(rand[0]);
+
+            if (sense_f == 0 && sense_l == 0 && sense_r == 0) { // if there is no trail to sense, just go crazy
+                current_agent.angle += (steer_strength - 0.5f) * 2 * turn_speed;
+            } else if (sense_f > sense_l && sense_f > sense_r) { // if there is trail in front, then stay the course
+                current_agent.angle += 0;
+            } else if (sense_f < sense_l && sense_f < sense_r) { // if there is equal parts left and right, turn in a random direction
+                current_agent.angle += (steer_strength - 0.5f) * 2 * turn_speed;
+            } else if (sense_l > sense_r) { // if left is greater, then go left
+                current_agent.angle += steer_strength * turn_speed;
+            } else if (sense_l < sense_r) { // if right is greater, then go right
+                current_agent.angle -= steer_strength * turn_speed;
+            } else { // otherwise go crazy
+                current_agent.angle += (steer_strength - 0.5f) * 2 * turn_speed;
+            }
+
+            // move the agent in its new angle
+            current_agent.x += run_settings.move_speed * std::cos(current_agent.angle);
+            current_agent.y += run_settings.move_speed * std::sin(current_agent.angle);
+
+            int width = run_settings.width;
+            int height = run_settings.height;
+            if (Boundary == BOUNDARY_WRAP) {
+                // the map is a torus, the same as wrap_position in slime_mold.glsl
+                current_agent.x = wrap_position(current_agent.x, width);
+                current_agent.y = wrap_position(current_agent.y, height);
+            } else if (current_agent.x <= 0 || current_agent.x >= width || current_agent.y <= 0 || current_agent.y >= height) {
+                current_agent.x = std::min((float)(width - 1), std::max(0.0f, current_agent.x));
+                current_agent.y = std::min((float)(height - 1), std::max(0.0f, current_agent.y));
+                // check if it hits the wall, then bounce it off the wall in a random direction
+                current_agent.angle = rng_unit(rand[1]) * 2 * 3.1415926535f;
+            }
+
+            agent_list[id] = current_agent;
+        }
+
+        // adds one agent's trail at its pixel and draws it into the agent map
+        void deposit(const engine_agent& current_agent) {
+            int width = run_settings.width;
+            size_t pixel = ((size_t)(int)current_agent.y * width + (int)current_agent.x) * 4;
+            float agent_color[4] = { run_settings.r, run_settings.g, run_settings.b, 1 };
+
+            if (DrawAgents)
+                std::copy(agent_color, agent_color + 4, &agent_map[pixel]);
+
+            for (int c = 0; c < 4; c++) {
+                float deposit = c == 3 ? 1.0f : agent_color[c] / 5;
+                trail[pixel + c] = Trail::store(std::min(Trail::load(trail[pixel + c]) + deposit, agent_color[c]));
+            }
+        }
+
+    public:
+        /*
+            CpuEngine contructor
+
+            takes in the settings, the agents, the sensor footprint, the number of threads (0 for every core)
+            and the step the agents are at
+        */
+        CpuEngine(const engine_settings& settings, const std::vector<engine_agent>& agents, int footprint, int thread_count, uint64_t step) :
+            run_settings(settings), sensor_size(footprint), threads(thread_count), steps(step), agent_list(agents) {
+            pow2_map = is_pow2(run_settings.width) && is_pow2(run_settings.height);
+            key = { run_settings.seed_lo, run_settings.seed_hi };
+            size_t channels = (size_t)run_settings.width * run_settings.height * 4;
+            trail.assign(channels, Trail::store(0));
+            scratch.assign(channels, Trail::store(0));
+            if (DrawAgents)
+                agent_map.assign(channels, 0.0f);
+            if (SensorSize == 0)
+                summed_area.assign((size_t)run_settings.width * run_settings.height, 0);
+        }
+
+        /*
+            load_trail function
+
+            takes in width * height RGBA floats, bottom row first
+
+            description:
+                replaces the trail map, used to continue from a snapshot
+        */
+        void load_trail(const float* rgba) {
+            for (size_t i = 0; i < trail.size(); i++)
+                trail[i] = Trail::store(rgba[i]);
+        }
+
+        void step(bool clear_agents) override {
+            pool.run(run_settings.height, threads, [&](int y) { diffuse_row(y); });
+            std::swap(trail, scratch);
+            if (SensorSize == 0) {
+                build_summed_area(pool, threads, run_settings.width, run_settings.height,
+                    [&](int x, int y) { return sense_value(x, y); }, summed_area.data());
+            }
+
+            if (DrawAgents && clear_agents)
+                std::fill(agent_map.begin(), agent_map.end(), 0.0f);
+
+            // the agents are handed out in blocks so the threads don't fight over the counter
+            const int block = 1024;
+            int agent_count = (int)agent_list.size();
+            pool.run((agent_count + block - 1) / block, threads, [&](int first_block) {
+                int end = std::min(agent_count, (first_block + 1) * block);
+                for (int id = first_block * block; id < end; id++)
+                    move_agent(id);
+            });
+            for (const engine_agent& current_agent : agent_list)
+                deposit(current_agent);
+
+            steps++;
+        }
+
+        void read_trail(float* rgba) const override {
+            for (size_t i = 0; i < trail.size(); i++)
+                rgba[i] = Trail::load(trail[i]);
+        }
+
+        void read_agent_map(float* rgba) const override {
+            if (DrawAgents)
+                std::copy(agent_map.begin(), agent_map.end(), rgba);
+            else
+                std::fill(rgba, rgba + trail.size(), 0.0f);
+        }
+
+        const engine_settings& settings() const override { return run_settings; }
+        const std::vector<engine_agent>& agents() const override { return agent_list; }
+        uint64_t step_count() const override { return steps; }
+        void set_threads(int count) override { threads = count; }
+
+        void restart(const engine_settings& settings, const std::vector<engine_agent>& agents) override {
+            run_settings = settings;
+            key = { run_settings.seed_lo, run_settings.seed_hi };
+            steps = 0;
+            pow2_map = is_pow2(run_settings.width) && is_pow2(run_settings.height);
+
+            // the sizes are the same, so assign and fill only write over what is there
+            size_t channels = (size_t)run_settings.width * run_settings.height * 4;
+            agent_list.assign(agents.begin(), agents.end());
+            trail.assign(channels, Trail::store(0));
+            scratch.assign(channels, Trail::store(0));
+            if (DrawAgents)
+                std::fill(agent_map.begin(), agent_map.end(), 0.0f);
+        }
+};
+
+/*
+    engine dispatch functions
+
+    description:
+        each one turns one run time option into a template argument and hands on to the next
+        so make_engine ends up calling the one constructor compiled for all four options
+*/
+template <int Boundary, int SensorSize, typename Trail>
+Engine* make_engine_drawing(const kernel_options& options, const engine_settings& settings, const std::vector<engine_agent>& agents,
+    int threads, uint64_t step) {
+    if (options.draw_agents)
+        return new CpuEngine<Boundary, SensorSize, Trail, true>(settings, agents, options.sensor_size, threads, step);
+    return new CpuEngine<Boundary, SensorSize, Trail, false>(settings, agents, options.sensor_size, threads, step);
+}
+template <int Boundary, int SensorSize>
+Engine* make_engine_precision(const kernel_options& options, const engine_settings& settings, const std::vector<engine_agent>& agents,
+    int threads, uint64_t step) {
+    switch (options.trail_precision) {
+    case TRAIL_F16:
+        return make_engine_drawing<Boundary, SensorSize, trail_f16>(options, settings, agents, threads, step);
+    case TRAIL_U16:
+        return make_engine_drawing<Boundary, SensorSize, trail_u16>(options, settings, agents, threads, step);
+    default:
+        return make_engine_drawing<Boundary, SensorSize, trail_f32>(options, settings, agents, threads, step);
+    }
+}
+template <int Boundary>
+Engine* make_engine_footprint(const kernel_options& options, const engine_settings& settings, const std::vector<engine_agent>& agents,
+    int threads, uint64_t step) {
+    switch (options.sensor_size) {
+    case 1:
+        return make_engine_precision<Boundary, 1>(options, settings, agents, threads, step);
+    case 3:
+        return make_engine_precision<Boundary, 3>(options, settings, agents, threads, step);
+    case 5:
+        return make_engine_precision<Boundary, 5>(options, settings, agents, threads, step);
+    default:
+        return make_engine_precision<Boundary, 0>(options, settings, agents, threads, step);
+    }
+}
+
+/*
+    make_engine function
+
+    takes in the kernel options, the settings, the agents, the number of threads (0 for every core) and the step the agents are at
+    returns a new engine compiled for the options, the caller deletes it
+*/
+inline Engine* make_engine(const kernel_options& options, const engine_settings& settings, const std::vector<engine_agent>& agents,
+    int threads, uint64_t step) {
+    switch (options.boundary_mode) {
+    case BOUNDARY_ZERO:
+        return make_engine_footprint<BOUNDARY_ZERO>(options, settings, agents, threads, step);
+    case BOUNDARY_WRAP:
+        return make_engine_footprint<BOUNDARY_WRAP>(options, settings, agents, threads, step);
+    default:
+        return make_engine_footprint<BOUNDARY_CLAMP>(options, settings, agents, threads, step);
+    }
+}
+
+/*
+    engine_run struct
+
+    description:
+        everything a headless run reads from the settings file
+*/
+struct engine_run {
+    engine_settings settings;
+    kernel_options kernels;
+    int agent_count;
+    std::string spawn_method;
+    uint64_t seed;
+    int threads; // the number of threads a run is spread over, 0 for every core
+    std::string checkpoint_path; // where the run's final snapshot goes
+};
+
+/*
+    read_engine_run function
+
+    takes in the path to the settings file and the run to fill in
+    returns true if the file was read
+
+    description:
+        reads the settings the same way Simulation::init_settings does, a missing or zero seed picks a random one
+*/
+inline bool read_engine_run(const char* path, engine_run& run) {
+    std::ifstream fin(path);
+    if (!fin) {
+        fprintf(stderr, "Could not load the settings json file.\n");
+        return false;
+    }
+
+    nlohmann::json settings_file;
+    fin >> settings_file;
+
+    run.agent_count = settings_file["agent_count"];
+    run.spawn_method = settings_file["spawn_method"];
+
+    run.settings.move_speed = settings_file["move_speed"];
+    run.settings.turn_speed = settings_file["turn_speed"];
+    run.settings.sensor_angle = settings_file["sensor_angle"];
+    run.settings.sensor_distance = settings_file["sensor_distance"];
+
+    run.settings.width = settings_file["map_width"];
+    run.settings.height = settings_file["map_height"];
+
+    run.settings.r = settings_file["color_r"].get<float>() / 255.0f;
+    run.settings.g = settings_file["color_g"].get<float>() / 255.0f;
+    run.settings.b = settings_file["color_b"].get<float>() / 255.0f;
+    run.settings.decay_rate = settings_file["decay_rate"];
+    run.settings.diffuse_rate = settings_file["diffuse_rate"];
+
+    run.seed = settings_file.value("seed", (uint64_t)0);
+    if (run.seed == 0) {
+        std::random_device rd;
+        run.seed = ((uint64_t)rd() << 32) | rd();
+        fprintf(stderr, "seed: %llu\n", (unsigned long long)run.seed);
+    }
+    philox_key key = make_philox_key(run.seed);
+    run.settings.seed_lo = key.k0;
+    run.settings.seed_hi = key.k1;
+
+    run.kernels.boundary_mode = parse_boundary(settings_file.value("boundary", std::string("clamp")));
+    run.kernels.sensor_size = std::max(1, settings_file.value("sensor_size", 3)) | 1;
+    run.kernels.trail_precision = parse_trail_precision(settings_file.value("trail_precision", std::string("f32")));
+    run.kernels.draw_agents = settings_file.value("draw_agents", true);
+    run.kernels.ghost_cells = settings_file.value("diffusion_blur", std::string("direct")) == "ghost";
+    run.kernels.pow2_map = is_pow2(run.settings.width) && is_pow2(run.settings.height);
+    run.kernels.species_count = 1;
+    run.kernels.dish_count = 1;
+
+    std::vector<species_settings> species;
+    int species_agents = 0;
+    if (read_species(settings_file, species, species_agents) > 1)
+        fprintf(stderr, "The cpu engine runs a single species, the species list is ignored.\n");
+    kernel_options dishes = run.kernels;
+    if (read_dishes(settings_file, species, dishes, species_agents) > 1)
+        fprintf(stderr, "The cpu engine runs a single dish, the dishes are ignored.\n");
+
+    run.threads = settings_file.value("engine_threads", 0);
+    run.checkpoint_path = settings_file.value("checkpoint_path", std::string("./checkpoint.slime"));
+    return true;
+}
+
+/*
+    make_engine function
+
+    takes in a run read by read_engine_run
+    returns a new engine with the run's agents spawned, the caller deletes it
+*/
+inline Engine* make_engine(const engine_run& run) {
+    std::vector<engine_agent> agents(run.agent_count);
+    spawn_agents(agents.data(), run.agent_count, run.spawn_method, run.settings.width, run.settings.height, run.seed);
+    return make_engine(run.kernels, run.settings, agents, run.threads, 0);
+}
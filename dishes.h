@@ -0,0 +1,107 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <json.hpp>
+
+#include "kernels.h"
+#include "species.h"
+
+/*
+    dishes
+
+    description:
+        a run can pack many small independent simulations (dishes) into the one map, a grid of dishes side by side
+        the one diffusion pass and the one agent dispatch advance all of them, so a parameter study of a few hundred
+        small runs costs one window and one context instead of a process each
+
+        every dish is a block of tiles, and its edges are the boundary: the blur never reaches into the dish next to it
+        and the agents bounce off (or wrap around) the edges of their own dish
+        the agents of a dish are one block of ids, the same number in every dish, so an agent's dish is its id divided
+        by that number and nothing is added to the agents
+
+        every dish has its own entry in the species table (see species.h), so it has its own movement, sensors,
+        colour, decay and diffusion, the grid is filled row by row and the slots left over at the end are empty
+*/
+
+#define MAX_DISHES 256
+#define DISH_TILE_SIZE 16 // the size of an activity tile, the dishes are whole tiles so a tile is never in two dishes
+
+/*
+    read_dishes function
+
+    takes in the settings file, the species table to fill, the kernel options to fill with the layout
+    and the total agent count to fill in
+    returns the number of dishes, 1 when the settings file has no dishes
+
+    description:
+        "dishes" is either a number of dishes that all run the top level settings, or a list with an entry per dish
+        an entry can set color_r, color_g, color_b, move_speed, turn_speed, sensor_angle, sensor_distance, decay_rate
+        and diffuse_rate, anything it leaves out comes from the top level settings
+        "dish_width" and "dish_height" are the size of each dish and "agent_count" is split evenly between them
+*/
+inline int read_dishes(const nlohmann::json& settings_file, std::vector<species_settings>& table, kernel_options& options, int& agent_count) {
+    options.dish_count = 1;
+    options.dish_columns = 1;
+    options.dish_width = options.dish_height = options.dish_agents = 0;
+    if (!settings_file.contains("dishes"))
+        return 1;
+
+    const nlohmann::json& dishes = settings_file["dishes"];
+    int count = dishes.is_number() ? dishes.get<int>() : (int)dishes.size();
+    if (count < 2)
+        return 1;
+    if (count > MAX_DISHES) {
+        fprintf(stderr, "Only the first %d dishes are run.\n", MAX_DISHES);
+        count = MAX_DISHES;
+    }
+
+    int width = std::max(1, settings_file.value("dish_width", 256));
+    int height = std::max(1, settings_file.value("dish_height", 256));
+    if (width % DISH_TILE_SIZE || height % DISH_TILE_SIZE) {
+        fprintf(stderr, "The dish size has to be a multiple of %d, it is rounded up.\n", DISH_TILE_SIZE);
+        width = (width + DISH_TILE_SIZE - 1) / DISH_TILE_SIZE * DISH_TILE_SIZE;
+        height = (height + DISH_TILE_SIZE - 1) / DISH_TILE_SIZE * DISH_TILE_SIZE;
+    }
+
+    options.dish_count = count;
+    options.dish_columns = (int)std::ceil(std::sqrt((double)count));
+    options.dish_width = width;
+    options.dish_height = height;
+    options.dish_agents = std::max(1, settings_file["agent_count"].get<int>() / count);
+    agent_count = options.dish_agents * count;
+
+    // the slots past the last dish get the top level settings and no agents
+    int slots = options.dish_columns * ((count + options.dish_columns - 1) / options.dish_columns);
+    table.clear();
+    for (int i = 0; i < slots; i++) {
+        const nlohmann::json& entry = dishes.is_array() && i < count ? dishes[i] : nlohmann::json::object();
+        species_settings dish = legacy_species(
+            entry.value("move_speed", settings_file["move_speed"].get<float>()),
+            entry.value("turn_speed", settings_file["turn_speed"].get<float>()),
+            entry.value("sensor_angle", settings_file["sensor_angle"].get<float>()),
+            entry.value("sensor_distance", settings_file["sensor_distance"].get<float>()),
+            entry.value("color_r", settings_file["color_r"].get<float>()) / 255.0f,
+            entry.value("color_g", settings_file["color_g"].get<float>()) / 255.0f,
+            entry.value("color_b", settings_file["color_b"].get<float>()) / 255.0f,
+            entry.value("decay_rate", settings_file["decay_rate"].get<float>()),
+            entry.value("diffuse_rate", settings_file["diffuse_rate"].get<float>()));
+        dish.first_agent = (uint32_t)(std::min(i, count) * options.dish_agents);
+        table.push_back(dish);
+    }
+    return count;
+}
+
+/*
+    dish_rows function
+
+    takes in the kernel options
+    returns the number of dishes down the map
+*/
+inline int dish_rows(const kernel_options& options) {
+    return (options.dish_count + options.dish_columns - 1) / options.dish_columns;
+}
@@ -6,11 +6,188 @@
 	Description:
 		This is the driver code for the slime mold simulation. Most of the program loop occurs in the Simulation class.
 		Eventually, I may try to add different colored slimes in 1 sim, or even running multiple slimes in a "petri dish" concurrently.
+
+	Usage:
+		driver [--resume snapshot] [--benchmark steps] [--cpu steps] [--sweep sweep_file] [--search search_file]
+			[--replay series_file [step]]
+			--resume - continues a run from a snapshot saved with the f5 key
+			--benchmark - runs the given number of steps in a hidden window and prints how long the full and sparse diffusion took
+			--cpu - runs the given number of steps on the cpu engine with no window and saves a snapshot to the checkpoint path
+			--sweep - runs the settings on the cpu engine once for every point of the sweep file, see sweep.h
+			--search - fits the settings the search file names to its target on the cpu engine, see search.h
+			--replay - decodes every record of a series and prints how far it was compressed, given a step
+				that record is saved as a snapshot next to the series so --resume can pick it up
 */
+#include <ctype.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
 #include "simulation.h"
+#include "cpu_engine.h"
+#include "sweep.h"
+#include "search.h"
+
+/*
+	run_cpu function
+
+	takes in the number of steps to run
+	returns 0 if the run finished and its snapshot was saved
+
+	description:
+		runs the settings file on the cpu engine compiled for its kernel options, then saves where the f5 key would
+*/
+int run_cpu(int steps) {
+	engine_run run;
+	if (!read_engine_run("./settings.json", run))
+		return -1;
+
+	Engine* engine = make_engine(run);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < steps; i++)
+		engine->step(i == steps - 1);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fprintf(stderr, "%d steps on the cpu in %.3f s, %.3f ms a step\n", steps, seconds, seconds * 1000.0 / steps);
+
+	bool saved = engine->save(run.checkpoint_path, run.seed);
+	delete engine;
+	return saved ? 0 : -1;
+}
+
+/*
+	sweep function
+
+	takes in the path to the sweep file
+	returns 0 if every run of the sweep finished
+
+	description:
+		runs the settings file on the cpu engine with the settings the sweep file varies, picking up where a stopped sweep left off
+*/
+int sweep(const char* sweep_file) {
+	engine_run base;
+	sweep_spec spec;
+	if (!read_engine_run("./settings.json", base) || !read_sweep(sweep_file, spec))
+		return -1;
+	return run_sweep(base, spec) ? 0 : -1;
+}
+
+/*
+	search function
+
+	takes in the path to the search file
+	returns 0 if the search finished and wrote its results
+
+	description:
+		fits the settings file to the search file's target on the cpu engine, the best settings go to the results directory
+*/
+int search(const char* search_file) {
+	engine_run base;
+	search_spec spec;
+	if (!read_engine_run("./settings.json", base) || !read_search(search_file, base.settings, spec))
+		return -1;
+
+	ParameterSearch parameter_search(spec, base);
+	return parameter_search.run() ? 0 : -1;
+}
+
+/*
+	replay function
+
+	takes in the path to the series and the step to save as a snapshot, or -1 for none
+	returns 0 if every record decoded and the snapshot, if one was asked for, was saved
+
+	description:
+		reads the series back the way it was recorded, checking every record, and prints the records with the space they
+		take against plain snapshots, the snapshot starts its random numbers from the series seed and not where the run was
+*/
+int replay(const char* series_file, long long save_step) {
+	SeriesReader reader;
+	if (!reader.open(series_file))
+		return -1;
+	const series_header& header = reader.header;
+
+	std::vector<unsigned char> agents((size_t)header.agent_count * header.agent_size);
+	std::vector<float> trail((size_t)header.width * header.height * 4);
+	long long records = 0;
+	bool saved = save_step < 0;
+	uint64_t step = 0;
+	while (reader.next(step, agents.data(), trail.data())) {
+		records++;
+		if ((long long)step != save_step)
+			continue;
+
+		std::string path = std::string(series_file) + "." + std::to_string(step) + ".snapshot";
+		snapshot_header snapshot = make_snapshot_header(header.width, header.height, header.agent_count, header.agent_size,
+			(uint32_t)reader.settings.size(), GL_RGBA32F, 4 * sizeof(float), header.seed, step);
+		saved = write_snapshot(path, snapshot, reader.settings.data(), agents.data(), trail.data());
+		if (saved)
+			fprintf(stderr, "saved the record of step %llu to %s\n", (unsigned long long)step, path.c_str());
+	}
+
+	FILE* file = fopen(series_file, "rb");
+	double file_bytes = 0;
+	if (file) {
+		fseek(file, 0, SEEK_END);
+		file_bytes = (double)ftell(file);
+		fclose(file);
+	}
+	double plain_bytes = (double)records * (agents.size() + trail.size() * sizeof(float));
+	fprintf(stderr, "%lld records up to step %llu, %.1f MB against %.1f MB of plain snapshots, %.1fx smaller\n",
+		records, (unsigned long long)step, file_bytes * 1e-6, plain_bytes * 1e-6, plain_bytes / std::max(file_bytes, 1.0));
+	if (!saved)
+		fprintf(stderr, "The series has no record of step %lld.\n", save_step);
+	return records > 0 && saved ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+	const char* resume_path = NULL;
+	int benchmark_steps = 0;
+	int cpu_steps = 0;
+	const char* sweep_file = NULL;
+	const char* search_file = NULL;
+	const char* replay_file = NULL;
+	long long replay_step = -1;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+			resume_path = argv[++i];
+		} else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+			benchmark_steps = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+			cpu_steps = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+			sweep_file = argv[++i];
+		} else if (strcmp(argv[i], "--search") == 0 && i + 1 < argc) {
+			search_file = argv[++i];
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay_file = argv[++i];
+			if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+				replay_step = atoll(argv[++i]);
+		} else {
+			fprintf(stderr, "Unknown argument %s.\nUsage: %s [--resume snapshot] [--benchmark steps] [--cpu steps] [--sweep sweep_file]"
+				" [--search search_file] [--replay series_file [step]]\n",
+				argv[i], argv[0]);
+			return -1;
+		}
+	}
+
+	// the cpu engine needs no window, so it runs before the simulation opens one
+	if (cpu_steps > 0)
+		return run_cpu(cpu_steps);
+	if (sweep_file)
+		return sweep(sweep_file);
+	if (search_file)
+		return search(search_file);
+	if (replay_file)
+		return replay(replay_file, replay_step);
 
-int main() {
 	Simulation sim; // creating the sim object
-	sim.run(); // running the simulation
+	if (resume_path && !sim.load(resume_path))
+		exit(SNAPSHOT_LOAD_FAIL);
+	if (benchmark_steps > 0)
+		sim.benchmark(benchmark_steps);
+	else
+		sim.run(); // running the simulation
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,281 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define GLEW_STATIC
+#include <glew.h>
+
+#include "readback.h"
+#include "shader.h"
+#include "snapshot.h"
+
+/*
+    flight recording file format
+
+    description:
+        a dump of the flight recorder ring, oldest frame first
+        every frame is its step, the downsampled trail map as RGBA8 (bottom row first, like the trail map)
+        and the sampled agents, which are copied straight out of the agent buffer
+
+        | flight_header | step | pixels | agents | step | pixels | agents | ...
+*/
+
+#define FLIGHT_MAGIC "SLIMFLIT"
+#define FLIGHT_VERSION 1
+
+struct flight_header {
+    char magic[8]; // FLIGHT_MAGIC, without the null terminator
+    uint32_t version; // FLIGHT_VERSION
+    uint32_t endian_check; // SNAPSHOT_ENDIAN_CHECK
+    uint32_t header_size; // sizeof(flight_header)
+
+    int32_t map_width; // the size of the trail map
+    int32_t map_height;
+    int32_t frame_width; // the size of the downsampled frames
+    int32_t frame_height;
+    int32_t factor; // the size of the block each frame pixel averages
+    int32_t sample_count; // the number of agents in each frame
+    int32_t sample_stride; // every sample_stride agent was sampled
+    uint32_t agent_size; // bytes per sampled agent
+    uint32_t frame_count; // the number of frames in the dump
+    uint64_t seed;
+};
+
+/*
+    FlightRecorder class
+
+    description:
+        keeps the last few hundred steps around so an interesting moment can still be saved after it has happened
+        every recorded step a small compute shader averages the trail map down into blocks and gathers every nth agent,
+        and writes both straight into the next slot of a ring that lives in one persistently mapped buffer
+        so recording is one tiny dispatch with no copies, no cpu work and no allocations
+
+        a dump waits for the gpu once, copies the ring out oldest first into a buffer that was allocated up front,
+        and a writer thread writes the file while the simulation keeps going
+
+    member variables:
+        shader, trail_format
+        arena, slot_size, pixel_bytes, sample_offset
+        frame_width, frame_height, factor, sample_count, sample_stride
+        slot_count, steps, next_slot, recorded
+        dump, dump_prefix, dump_busy, dump_thread
+*/
+class FlightRecorder {
+    private:
+        ComputeShader shader;
+        GLenum trail_format; // the internal format the trail map is bound with
+
+        ReadbackBuffer arena; // every slot of the ring
+        size_t slot_size; // the bytes between two slots, a multiple of the storage buffer offset alignment
+        size_t pixel_bytes; // the bytes of the downsampled frame
+        size_t sample_offset; // where the agent samples start inside a slot
+        size_t sample_bytes; // the bytes of the agent samples
+
+        int map_width;
+        int map_height;
+        int frame_width;
+        int frame_height;
+        int factor;
+        int sample_count;
+        int sample_stride;
+        uint32_t agent_size;
+        uint64_t seed;
+
+        int slot_count;
+        std::vector<uint64_t> steps; // the step recorded in each slot
+        int next_slot = 0; // the slot the next step is recorded into
+        int recorded = 0; // the number of slots holding a step, up to slot_count
+
+        std::vector<unsigned char> dump; // the ring in order, allocated once
+        std::string dump_prefix; // the start of every dump file name
+        std::atomic<bool> dump_busy{ false }; // true while the writer thread owns the dump buffer
+        std::thread dump_thread;
+
+        static size_t align(size_t bytes, size_t alignment) {
+            return (bytes + alignment - 1) / alignment * alignment;
+        }
+
+        /*
+            write_dump function
+
+            takes in the path and the number of frames in the dump buffer
+
+            description:
+                runs on the dump thread
+        */
+        void write_dump(std::string path, uint32_t frame_count) {
+            flight_header header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, FLIGHT_MAGIC, sizeof(header.magic));
+            header.version = FLIGHT_VERSION;
+            header.endian_check = SNAPSHOT_ENDIAN_CHECK;
+            header.header_size = sizeof(flight_header);
+            header.map_width = map_width;
+            header.map_height = map_height;
+            header.frame_width = frame_width;
+            header.frame_height = frame_height;
+            header.factor = factor;
+            header.sample_count = sample_count;
+            header.sample_stride = sample_stride;
+            header.agent_size = agent_size;
+            header.frame_count = frame_count;
+            header.seed = seed;
+
+            size_t frame_bytes = sizeof(uint64_t) + pixel_bytes + sample_bytes;
+            FILE* fout = fopen(path.c_str(), "wb");
+            bool written = fout && fwrite(&header, sizeof(header), 1, fout) == 1;
+            written = written && fwrite(dump.data(), 1, frame_bytes * frame_count, fout) == frame_bytes * frame_count;
+            if (fout)
+                written = (fclose(fout) == 0) && written;
+
+            if (written)
+                fprintf(stderr, "saved the last %u recorded steps to %s\n", frame_count, path.c_str());
+            else
+                fprintf(stderr, "Could not write the flight recording to %s.\n", path.c_str());
+            dump_busy = false;
+        }
+
+    public:
+        /*
+            FlightRecorder contructor
+
+            takes in the number of steps kept, the downsampling factor, the agent sample stride,
+            the size of the map, the agent count and size, the seed, the start of the dump file names
+            and the trail map's internal format with the #define lines its shaders are compiled with (see kernels.h)
+
+            description:
+                allocates the ring and the dump buffer, nothing is allocated after this
+                has to run on the gl thread
+        */
+        FlightRecorder(int frames, int downsample, int stride, int width, int height, int agent_count, uint32_t agent_bytes,
+            uint64_t run_seed, const std::string& prefix, GLenum format = GL_RGBA32F, const std::string& defines = "") :
+            shader("./shaders/recorder.glsl", defines), trail_format(format), map_width(width), map_height(height), agent_size(agent_bytes), seed(run_seed),
+            dump_prefix(prefix) {
+            slot_count = frames > 0 ? frames : 1;
+            factor = downsample > 0 ? downsample : 1;
+            sample_stride = stride > 0 ? stride : 1;
+            frame_width = std::max(1, map_width / factor);
+            frame_height = std::max(1, map_height / factor);
+            sample_count = (agent_count + sample_stride - 1) / sample_stride;
+
+            GLint offset_alignment = 256;
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+            size_t alignment = std::max<size_t>(256, (size_t)offset_alignment);
+
+            pixel_bytes = (size_t)frame_width * frame_height * 4;
+            sample_bytes = (size_t)sample_count * agent_size;
+            sample_offset = align(pixel_bytes, alignment);
+            slot_size = align(sample_offset + std::max<size_t>(sample_bytes, 1), alignment);
+
+            arena.reserve(slot_size * slot_count);
+            steps.assign(slot_count, 0);
+            dump.resize((sizeof(uint64_t) + pixel_bytes + sample_bytes) * slot_count);
+        }
+
+        FlightRecorder(const FlightRecorder&) = delete;
+        FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+        ~FlightRecorder() {
+            if (dump_thread.joinable())
+                dump_thread.join();
+            arena.release();
+            glDeleteProgram(shader.program_id);
+        }
+
+        /*
+            record function
+
+            takes in the trail texture, the tile stamps (0 without lazy decay), the decay rate, the agent buffer
+            and the step the simulation is on
+
+            description:
+                records the step into the next slot, overwriting the oldest one once the ring is full
+                the caller makes sure the step's writes to the trail map and the agents are visible first
+        */
+        void record(GLuint trail_texture, GLuint stamp_buffer, float decay_rate, GLuint agent_buffer, uint64_t step) {
+            shader.use();
+            glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_READ_ONLY, trail_format);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, agent_buffer);
+            if (stamp_buffer)
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, stamp_buffer);
+            shader.set_bool("lazy", stamp_buffer != 0);
+            shader.set_float("decay_rate", decay_rate);
+            shader.set_int("decay_step", (int)step - 1);
+
+            GLintptr slot = (GLintptr)(next_slot * slot_size);
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 5, arena.buffer, slot, (GLsizeiptr)pixel_bytes);
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 6, arena.buffer, slot + (GLintptr)sample_offset, (GLsizeiptr)std::max<size_t>(sample_bytes, 1));
+
+            glUniform2i(glGetUniformLocation(shader.program_id, "frame_size"), frame_width, frame_height);
+            shader.set_int("factor", factor);
+            shader.set_int("sample_count", sample_count);
+            shader.set_int("sample_stride", sample_stride);
+
+            int invocations = std::max(frame_width * frame_height, sample_count);
+            shader.dispatch((invocations + 255) / 256, 1);
+
+            steps[next_slot] = step;
+            next_slot = (next_slot + 1) % slot_count;
+            recorded = std::min(recorded + 1, slot_count);
+        }
+
+        /*
+            dump_ring function
+
+            returns true if the dump was started, false if the last dump is still being written or nothing was recorded
+
+            description:
+                waits for the gpu to finish the recorded steps, copies the ring out oldest first
+                and starts a thread to write it to dump_prefix + the newest step + ".flight"
+        */
+        bool dump_ring() {
+            if (recorded == 0)
+                return false;
+            if (dump_busy) {
+                fprintf(stderr, "Skipped the flight recorder dump, the last one is still being written.\n");
+                return false;
+            }
+            if (dump_thread.joinable())
+                dump_thread.join();
+
+            glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+            glFinish();
+
+            const unsigned char* ring = (const unsigned char*)arena.mapped;
+            unsigned char* out = dump.data();
+            int oldest = (next_slot - recorded + slot_count) % slot_count;
+            for (int i = 0; i < recorded; i++) {
+                int slot = (oldest + i) % slot_count;
+                memcpy(out, &steps[slot], sizeof(uint64_t));
+                out += sizeof(uint64_t);
+                memcpy(out, ring + slot * slot_size, pixel_bytes);
+                out += pixel_bytes;
+                memcpy(out, ring + slot * slot_size + sample_offset, sample_bytes);
+                out += sample_bytes;
+            }
+
+            uint64_t newest = steps[(next_slot - 1 + slot_count) % slot_count];
+            std::string path = dump_prefix + std::to_string(newest) + ".flight";
+            dump_busy = true;
+            dump_thread = std::thread(&FlightRecorder::write_dump, this, path, (uint32_t)recorded);
+            return true;
+        }
+
+        /*
+            reset function
+
+            description:
+                forgets every recorded step, used when the simulation jumps to a snapshot
+        */
+        void reset() {
+            next_slot = 0;
+            recorded = 0;
+        }
+};
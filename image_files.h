@@ -0,0 +1,235 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#include <array>
+#include <vector>
+
+/*
+    image file encoders
+
+    description:
+        small dependency free encoders for frame dumps, each one fills a byte vector that the caller writes out
+            png - 8 bit RGB, the image data is stored in uncompressed deflate blocks, so encoding is only a copy and two checksums
+            exr - 32 bit float RGB scanline image with no compression, so the trail map keeps its full range
+*/
+
+/*
+    crc32 function
+
+    takes in the running crc, a pointer to some bytes and the number of bytes
+    returns the updated crc, start with 0
+*/
+inline uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    // built once, the static initialization is thread safe so the writer threads can all call this
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> values;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            values[i] = value;
+        }
+        return values;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline void put_u32_be(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back((uint8_t)(value >> 24));
+    out.push_back((uint8_t)(value >> 16));
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)value);
+}
+
+inline void put_le(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+/*
+    encode_png function
+
+    takes in top row first RGB pixels, the size, and the output vector
+*/
+inline void encode_png(const uint8_t* rgb, int width, int height, std::vector<uint8_t>& out) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.clear();
+    out.insert(out.end(), signature, signature + 8);
+
+    // writes a chunk whose data is already at the end of out, starting at data_start
+    auto finish_chunk = [&out](size_t length_position) {
+        size_t data_start = length_position + 8;
+        uint32_t length = (uint32_t)(out.size() - data_start);
+        out[length_position + 0] = (uint8_t)(length >> 24);
+        out[length_position + 1] = (uint8_t)(length >> 16);
+        out[length_position + 2] = (uint8_t)(length >> 8);
+        out[length_position + 3] = (uint8_t)length;
+        put_u32_be(out, crc32(0, out.data() + length_position + 4, length + 4));
+    };
+    auto start_chunk = [&out](const char* type) {
+        size_t length_position = out.size();
+        put_u32_be(out, 0);
+        out.insert(out.end(), type, type + 4);
+        return length_position;
+    };
+
+    size_t chunk = start_chunk("IHDR");
+    put_u32_be(out, (uint32_t)width);
+    put_u32_be(out, (uint32_t)height);
+    out.push_back(8); // bit depth
+    out.push_back(2); // RGB
+    out.push_back(0); // deflate
+    out.push_back(0); // adaptive filtering
+    out.push_back(0); // no interlacing
+    finish_chunk(chunk);
+
+    // the zlib stream, every row is a filter byte of 0 followed by the row
+    size_t row_bytes = (size_t)width * 3;
+    size_t raw_size = (row_bytes + 1) * height;
+    const size_t max_block = 65535;
+    out.reserve(out.size() + raw_size + raw_size / max_block * 5 + 64);
+
+    chunk = start_chunk("IDAT");
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    uint32_t adler_a = 1, adler_b = 0;
+    size_t block_left = 0;
+    size_t raw_left = raw_size;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = rgb + (size_t)y * row_bytes;
+        for (size_t i = 0; i <= row_bytes; i++) {
+            if (block_left == 0) {
+                block_left = raw_left < max_block ? raw_left : max_block;
+                out.push_back(raw_left == block_left ? 1 : 0); // final block flag, stored block type
+                put_le(out, block_left, 2);
+                put_le(out, ~block_left & 0xFFFF, 2);
+            }
+
+            // the filter byte comes first, then the row, copied in runs up to the end of the block
+            size_t run = 1;
+            if (i == 0) {
+                out.push_back(0);
+                adler_b = (adler_b + adler_a) % 65521;
+            } else {
+                run = row_bytes - i + 1;
+                run = run < block_left ? run : block_left;
+                const uint8_t* bytes = row + i - 1;
+                out.insert(out.end(), bytes, bytes + run);
+                for (size_t j = 0; j < run; j++) {
+                    adler_a += bytes[j];
+                    adler_b += adler_a;
+                    if (j % 5552 == 5551) { // the most bytes that can be summed before adler_b could overflow
+                        adler_a %= 65521;
+                        adler_b %= 65521;
+                    }
+                }
+                adler_a %= 65521;
+                adler_b %= 65521;
+                i += run - 1;
+            }
+            block_left -= run;
+            raw_left -= run;
+        }
+    }
+    put_u32_be(out, (adler_b << 16) | adler_a);
+    finish_chunk(chunk);
+
+    chunk = start_chunk("IEND");
+    finish_chunk(chunk);
+}
+
+/*
+    encode_exr function
+
+    takes in RGBA float pixels bottom row first (as read back from gl), the size, and the output vector
+
+    description:
+        writes the R, G and B channels as 32 bit floats, exr wants the channels in alphabetical order
+        and the top row first, so each scanline is gathered into B, G and R runs while flipping
+*/
+inline void encode_exr(const float* rgba, int width, int height, std::vector<uint8_t>& out) {
+    out.clear();
+    put_le(out, 20000630, 4); // magic number
+    put_le(out, 2, 4); // version 2, single part scanline file
+
+    auto attribute = [&out](const char* name, const char* type, uint32_t size) {
+        out.insert(out.end(), name, name + strlen(name) + 1);
+        out.insert(out.end(), type, type + strlen(type) + 1);
+        put_le(out, size, 4);
+    };
+
+    const char* channels[3] = { "B", "G", "R" };
+    const int channel_offsets[3] = { 2, 1, 0 };
+    attribute("channels", "chlist", 3 * 18 + 1);
+    for (int c = 0; c < 3; c++) {
+        out.insert(out.end(), channels[c], channels[c] + 2);
+        put_le(out, 2, 4); // float pixels
+        put_le(out, 0, 4); // not linear, then three reserved bytes
+        put_le(out, 1, 4); // x sampling
+        put_le(out, 1, 4); // y sampling
+    }
+    out.push_back(0);
+
+    attribute("compression", "compression", 1);
+    out.push_back(0); // no compression
+
+    attribute("dataWindow", "box2i", 16);
+    put_le(out, 0, 4);
+    put_le(out, 0, 4);
+    put_le(out, (uint32_t)(width - 1), 4);
+    put_le(out, (uint32_t)(height - 1), 4);
+
+    attribute("displayWindow", "box2i", 16);
+    put_le(out, 0, 4);
+    put_le(out, 0, 4);
+    put_le(out, (uint32_t)(width - 1), 4);
+    put_le(out, (uint32_t)(height - 1), 4);
+
+    attribute("lineOrder", "lineOrder", 1);
+    out.push_back(0); // increasing y
+
+    float one = 1.0f, zero = 0.0f;
+    uint32_t one_bits, zero_bits;
+    memcpy(&one_bits, &one, 4);
+    memcpy(&zero_bits, &zero, 4);
+
+    attribute("pixelAspectRatio", "float", 4);
+    put_le(out, one_bits, 4);
+    attribute("screenWindowCenter", "v2f", 8);
+    put_le(out, zero_bits, 4);
+    put_le(out, zero_bits, 4);
+    attribute("screenWindowWidth", "float", 4);
+    put_le(out, one_bits, 4);
+    out.push_back(0); // end of the header
+
+    // the offset table, one entry per scanline
+    size_t line_bytes = (size_t)width * 3 * sizeof(float);
+    size_t table_start = out.size();
+    size_t first_line = table_start + (size_t)height * 8;
+    for (int y = 0; y < height; y++)
+        put_le(out, first_line + (size_t)y * (8 + line_bytes), 8);
+
+    out.resize(first_line + (size_t)height * (8 + line_bytes));
+    uint8_t* line = out.data() + first_line;
+    std::vector<float> values((size_t)width * 3);
+    for (int y = 0; y < height; y++) {
+        uint32_t y_bits = (uint32_t)y, size_bits = (uint32_t)line_bytes;
+        memcpy(line, &y_bits, 4);
+        memcpy(line + 4, &size_bits, 4);
+
+        const float* row = rgba + (size_t)(height - 1 - y) * width * 4;
+        for (int c = 0; c < 3; c++) {
+            float* channel = values.data() + (size_t)c * width;
+            for (int x = 0; x < width; x++)
+                channel[x] = row[x * 4 + channel_offsets[c]];
+        }
+        memcpy(line + 8, values.data(), line_bytes);
+        line += 8 + line_bytes;
+    }
+}
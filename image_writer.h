@@ -0,0 +1,188 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture.h"
+#include "pixels.h"
+#include "image_files.h"
+
+// the formats the image writer dumps
+#define IMAGE_PNG 0 // 8 bit RGB, float frames are tone mapped first
+#define IMAGE_EXR 1 // 32 bit float RGB, only for trail map captures
+
+/*
+    ImageWriter class
+
+    description:
+        a FrameSink that dumps every captured frame to its own image file, using a bounded pool of writer threads
+        a writer takes the frame lease itself, so the pixels are read straight out of the mapped pixel buffer with no copy,
+        tone maps (png) or reorders (exr) them, releases the lease and then encodes and writes the file
+
+        the files are numbered in the order the frames were accepted, not in the order the threads finish,
+        so the numbers stay in frame order and have no gaps even when frames are dropped
+        when every thread is busy and the queue is full, new frames are dropped and the writer reports it is falling behind
+
+    member variables:
+        prefix, format, tone_curve
+        threads
+        queue, queue_capacity, queue_lock, queue_signal
+        stopping
+        accepted, dropped, written
+*/
+class ImageWriter : public FrameSink {
+    private:
+        struct job {
+            CaptureFrame frame;
+            long long number; // the file number
+        };
+
+        std::string prefix; // the files are named prefix + number + extension
+        int format; // IMAGE_PNG or IMAGE_EXR
+        float tone_curve; // the strength of the png tone curve, see tone_map_rows_to_rgb8
+
+        std::vector<std::thread> threads;
+        std::deque<job> queue;
+        size_t queue_capacity;
+        std::mutex queue_lock;
+        std::condition_variable queue_signal;
+        bool stopping = false;
+
+        long long accepted = 0; // frames given a file number, guarded by queue_lock
+        long long dropped = 0; // frames dropped because the pool was behind, guarded by queue_lock
+        long long written = 0; // files written, guarded by queue_lock
+
+        /*
+            write_loop function
+
+            description:
+                one writer thread, takes jobs until the writer is stopped and the queue is empty
+                the buffers are kept between frames so a thread only allocates once
+        */
+        void write_loop() {
+            std::vector<uint8_t> rgb, file;
+            while (true) {
+                job current;
+                {
+                    std::unique_lock<std::mutex> lock(queue_lock);
+                    queue_signal.wait(lock, [this] { return stopping || !queue.empty(); });
+                    if (queue.empty())
+                        return;
+                    current = queue.front();
+                    queue.pop_front();
+                }
+
+                const CaptureFrame& frame = current.frame;
+                if (format == IMAGE_EXR) {
+                    encode_exr((const float*)frame.pixels, frame.width, frame.height, file);
+                    frame.release();
+                } else {
+                    rgb.resize((size_t)frame.width * frame.height * 3);
+                    if (frame.is_float)
+                        tone_map_rows_to_rgb8((const float*)frame.pixels, frame.width, frame.height, tone_curve, rgb.data());
+                    else
+                        byte_rows_to_rgb8((const uint8_t*)frame.pixels, frame.width, frame.height, rgb.data());
+                    frame.release();
+                    encode_png(rgb.data(), frame.width, frame.height, file);
+                }
+
+                char number[32];
+                snprintf(number, sizeof(number), "%06lld", current.number);
+                std::string path = prefix + number + (format == IMAGE_EXR ? ".exr" : ".png");
+
+                FILE* fout = fopen(path.c_str(), "wb");
+                bool saved = fout && fwrite(file.data(), 1, file.size(), fout) == file.size();
+                if (fout)
+                    saved = (fclose(fout) == 0) && saved;
+                if (!saved)
+                    fprintf(stderr, "Could not write the frame %s.\n", path.c_str());
+
+                std::lock_guard<std::mutex> lock(queue_lock);
+                written += saved ? 1 : 0;
+            }
+        }
+
+    public:
+        /*
+            ImageWriter contructor
+
+            takes in the file prefix, the format, the number of threads (0 for one less than the core count),
+            the number of frames that may wait for a thread and the png tone curve
+
+            description:
+                the queue holds at least one frame per thread, so a burst of frames can keep every thread busy
+                instead of being dropped while all but one of them sit idle
+        */
+        ImageWriter(const std::string& file_prefix, int image_format, int thread_count, int capacity, float curve) :
+            prefix(file_prefix), format(image_format), tone_curve(curve) {
+            if (thread_count <= 0)
+                thread_count = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+            queue_capacity = (size_t)std::max(capacity, thread_count);
+
+            for (int i = 0; i < thread_count; i++)
+                threads.emplace_back(&ImageWriter::write_loop, this);
+        }
+
+        /*
+            ImageWriter destructor
+
+            description:
+                writes every frame still queued before returning
+        */
+        ~ImageWriter() {
+            {
+                std::lock_guard<std::mutex> lock(queue_lock);
+                stopping = true;
+            }
+            queue_signal.notify_all();
+            for (std::thread& thread : threads)
+                thread.join();
+
+            fprintf(stderr, "The image writer wrote %lld frames and dropped %lld.\n", written, dropped);
+        }
+
+        /*
+            consume function
+
+            takes in a captured frame
+
+            description:
+                queues the frame with the next file number, or drops it if the pool is behind
+        */
+        void consume(const CaptureFrame& frame) override {
+            std::unique_lock<std::mutex> lock(queue_lock);
+            if (stopping || (format == IMAGE_EXR && !frame.is_float)) {
+                frame.release();
+                return;
+            }
+
+            if (queue.size() >= queue_capacity) {
+                frame.release();
+                // report the first drop and then every hundredth so a slow disk doesn't flood the console
+                if (dropped++ % 100 == 0)
+                    fprintf(stderr, "The image writer is falling behind, %lld frames dropped so far.\n", dropped);
+                return;
+            }
+
+            queue.push_back({ frame, accepted++ });
+            lock.unlock();
+            queue_signal.notify_one();
+        }
+
+        /*
+            behind function
+
+            returns true if the queue is full, so the next frame would be dropped
+        */
+        bool behind() {
+            std::lock_guard<std::mutex> lock(queue_lock);
+            return queue.size() >= queue_capacity;
+        }
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include <string>
+
+/*
+    kernel permutations
+
+    description:
+        the options below never change during a run, so instead of being uniforms that every pixel and every agent
+        branches on they are compiled into the kernels, and the branches for the options a run doesn't use are gone
+        the shaders get them as #defines put in after the #version line (see ComputeShader in shader.h)
+        and the cpu engine gets them as template arguments (see cpu_engine.h)
+        both pick their permutation once at startup from settings.json
+*/
+
+// what the pixels past the edge of the map hold
+#define BOUNDARY_CLAMP 0 // the edge pixel
+#define BOUNDARY_ZERO 1 // no trail
+#define BOUNDARY_WRAP 2 // the pixel on the other side of the map
+
+// what every channel of the trail map is stored as
+#define TRAIL_F32 0 // 32 bit float
+#define TRAIL_F16 1 // 16 bit float, half the memory traffic of f32
+#define TRAIL_U16 2 // 16 bit unsigned normalized, the trail has to stay in [0, 1]
+
+struct kernel_options {
+    int boundary_mode; // one of the BOUNDARY modes
+    int sensor_size; // the width of the square each sensor sums, an odd number
+    int trail_precision; // one of the TRAIL precisions
+    bool draw_agents; // false leaves the agent map alone, for runs nobody watches
+    bool pow2_map; // the map is a power of two both ways, so wrapping around it is a mask
+    int species_count; // 1 to MAX_SPECIES, see species.h
+    bool ghost_cells; // the blur reads each tile from shared memory with a ring of ghost cells, false reads every tap from the image
+
+    // the dishes packed into the map, see dishes.h
+    int dish_count; // 1 when the map is one run
+    int dish_columns; // the dishes across the map
+    int dish_width; // the size of every dish, a multiple of the tile size
+    int dish_height;
+    int dish_agents; // the agents in every dish
+};
+
+/*
+    is_pow2 function
+
+    takes in a map width or height
+    returns true if it is a power of two
+*/
+inline bool is_pow2(int size) {
+    return size > 0 && (size & (size - 1)) == 0;
+}
+
+/*
+    parse_boundary function
+
+    takes in the boundary name from the settings file
+    returns the BOUNDARY mode, clamp for anything it doesn't know
+*/
+inline int parse_boundary(const std::string& name) {
+    if (name == "wrap")
+        return BOUNDARY_WRAP;
+    if (name == "zero")
+        return BOUNDARY_ZERO;
+    return BOUNDARY_CLAMP;
+}
+
+/*
+    parse_trail_precision function
+
+    takes in the precision name from the settings file
+    returns the TRAIL precision, f32 for anything it doesn't know
+*/
+inline int parse_trail_precision(const std::string& name) {
+    if (name == "f16")
+        return TRAIL_F16;
+    if (name == "u16")
+        return TRAIL_U16;
+    return TRAIL_F32;
+}
+
+/*
+    trail_image_format function
+
+    takes in a TRAIL precision
+    returns the glsl image format qualifier of the trail map
+*/
+inline const char* trail_image_format(int precision) {
+    switch (precision) {
+    case TRAIL_F16:
+        return "rgba16f";
+    case TRAIL_U16:
+        return "rgba16";
+    default:
+        return "rgba32f";
+    }
+}
+
+/*
+    kernel_defines function
+
+    takes in the kernel options
+    returns the #define lines that compile the shaders for them
+
+    description:
+        every shader has a default for each of these, so a shader compiled without them is the f32, clamped,
+        3x3 permutation with the agents drawn, no power of two wrapping, one species, no dishes and the direct blur
+*/
+inline std::string kernel_defines(const kernel_options& options) {
+    std::string defines;
+    defines += "#define BOUNDARY_MODE " + std::to_string(options.boundary_mode) + "\n";
+    defines += "#define SENSOR_SIZE " + std::to_string(options.sensor_size) + "\n";
+    defines += std::string("#define TRAIL_FORMAT ") + trail_image_format(options.trail_precision) + "\n";
+    defines += std::string("#define DRAW_AGENTS ") + (options.draw_agents ? "1" : "0") + "\n";
+    defines += std::string("#define WRAP_POW2 ") + (options.pow2_map ? "1" : "0") + "\n";
+    defines += "#define SPECIES_COUNT " + std::to_string(options.species_count) + "\n";
+    defines += "#define DISH_COUNT " + std::to_string(options.dish_count) + "\n";
+    defines += std::string("#define GHOST_CELLS ") + (options.ghost_cells ? "1" : "0") + "\n";
+    if (options.dish_count > 1) {
+        defines += "#define DISH_COLUMNS " + std::to_string(options.dish_columns) + "\n";
+        defines += "#define DISH_WIDTH " + std::to_string(options.dish_width) + "\n";
+        defines += "#define DISH_HEIGHT " + std::to_string(options.dish_height) + "\n";
+        defines += "#define DISH_AGENTS " + std::to_string(options.dish_agents) + "\n";
+    }
+    return defines;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <stddef.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+    trail metrics
+
+    description:
+        a few numbers that sum up what a trail map looks like, so runs can be compared without looking at every frame
+        the trail map is RGBA floats, bottom row first, and a pixel's trail is the sum of its r, g and b
+*/
+struct trail_metrics {
+    float mean; // the average trail of a pixel
+    float deviation; // the standard deviation of the trail
+    float coverage; // the fraction of pixels holding more than a tenth of the brightest pixel's trail
+    float edges; // the average difference to the pixels right and up, high for thin networks and low for blobs or noise
+};
+
+// a metric of trail_metrics, by its name in result and search files
+struct trail_metric {
+    const char* name;
+    float trail_metrics::* field;
+};
+
+/*
+    trail_metric_list function
+
+    returns every metric of trail_metrics
+*/
+inline const std::vector<trail_metric>& trail_metric_list() {
+    static const std::vector<trail_metric> metrics = {
+        { "mean", &trail_metrics::mean },
+        { "deviation", &trail_metrics::deviation },
+        { "coverage", &trail_metrics::coverage },
+        { "edges", &trail_metrics::edges },
+    };
+    return metrics;
+}
+
+/*
+    measure_trail function
+
+    takes in the trail map and its size
+    returns the trail metrics of the map
+*/
+inline trail_metrics measure_trail(const float* rgba, int width, int height) {
+    size_t pixels = (size_t)width * height;
+    double sum = 0, square_sum = 0, edge_sum = 0;
+    float brightest = 0;
+    for (int y = 0; y < height; y++) {
+        const float* row = rgba + (size_t)y * width * 4;
+        const float* next_row = y + 1 < height ? row + (size_t)width * 4 : row;
+        for (int x = 0; x < width; x++) {
+            float trail = row[x * 4] + row[x * 4 + 1] + row[x * 4 + 2];
+            float right = x + 1 < width ? row[x * 4 + 4] + row[x * 4 + 5] + row[x * 4 + 6] : trail;
+            float up = next_row[x * 4] + next_row[x * 4 + 1] + next_row[x * 4 + 2];
+
+            sum += trail;
+            square_sum += (double)trail * trail;
+            edge_sum += (std::fabs(right - trail) + std::fabs(up - trail)) / 2;
+            brightest = std::max(brightest, trail);
+        }
+    }
+
+    trail_metrics metrics = {};
+    if (pixels == 0)
+        return metrics;
+    metrics.mean = (float)(sum / pixels);
+    metrics.deviation = (float)std::sqrt(std::max(0.0, square_sum / pixels - (sum / pixels) * (sum / pixels)));
+    metrics.edges = (float)(edge_sum / pixels);
+
+    size_t covered = 0;
+    for (size_t i = 0; brightest > 0 && i < pixels; i++)
+        covered += rgba[i * 4] + rgba[i * 4 + 1] + rgba[i * 4 + 2] > brightest / 10;
+    metrics.coverage = (float)covered / pixels;
+    return metrics;
+}
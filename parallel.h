@@ -0,0 +1,157 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    parallel_for function
+
+    takes in the number of items, the number of threads (0 for every core) and a function taking an item index
+
+    description:
+        runs the function once for every item, spread over the threads
+        the threads take the next item from a shared counter, so uneven items still balance out
+        the calling thread works too, and the function returns once every item is done
+*/
+template <typename Function>
+void parallel_for(int count, int threads, Function function) {
+    if (threads <= 0)
+        threads = (int)std::thread::hardware_concurrency();
+    if (threads > count)
+        threads = count;
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++)
+            function(i);
+        return;
+    }
+
+    std::atomic<int> next(0);
+    auto work = [&]() {
+        for (int i = next++; i < count; i = next++)
+            function(i);
+    };
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threads; i++)
+        helpers.emplace_back(work);
+    work();
+    for (std::thread& helper : helpers)
+        helper.join();
+}
+
+/*
+    WorkerPool class
+
+    description:
+        the same work sharing as parallel_for, but the threads are made once and sleep between calls
+        so a loop that calls it every step doesn't start and join threads every time
+        the pool grows to the most threads it was ever asked for, a call asking for fewer leaves the rest asleep
+
+    member variables:
+        workers, lock, start_signal, done_signal, stopping
+        call, context, count, helpers, next, busy, generation
+*/
+class WorkerPool {
+    private:
+        std::vector<std::thread> workers;
+        std::mutex lock;
+        std::condition_variable start_signal; // a new call was handed out, or the pool is stopping
+        std::condition_variable done_signal; // the last helper finished its share of the call
+        bool stopping = false;
+
+        // the call being run, the function is passed as a pointer and the one line that calls it so nothing is allocated
+        void (*call)(void*, int) = NULL;
+        void* context = NULL;
+        int count = 0; // the items of the call
+        int helpers = 0; // the workers that take part in the call, the ones past it stay asleep
+        std::atomic<int> next{ 0 }; // the next item to hand out
+        int busy = 0; // the helpers still working on the call
+        uint64_t generation = 0; // counts the calls, so a worker knows a new one started
+
+        template <typename Function>
+        static void invoke(void* function, int item) {
+            (*(Function*)function)(item);
+        }
+
+        void work_loop(int index) {
+            uint64_t seen = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    start_signal.wait(guard, [&] { return stopping || (generation != seen && index < helpers); });
+                    if (stopping)
+                        return;
+                    seen = generation;
+                }
+
+                for (int i = next++; i < count; i = next++)
+                    call(context, i);
+
+                std::lock_guard<std::mutex> guard(lock);
+                if (--busy == 0)
+                    done_signal.notify_one();
+            }
+        }
+
+    public:
+        WorkerPool() {}
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        ~WorkerPool() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            start_signal.notify_all();
+            for (std::thread& worker : workers)
+                worker.join();
+        }
+
+        /*
+            run function
+
+            takes in the number of items, the number of threads (0 for every core) and a function taking an item index
+
+            description:
+                runs the function once for every item, the same as parallel_for, on the pool's threads and the calling one
+                only one thread may call it at a time
+        */
+        template <typename Function>
+        void run(int item_count, int threads, Function function) {
+            if (threads <= 0)
+                threads = (int)std::thread::hardware_concurrency();
+            if (threads > item_count)
+                threads = item_count;
+            if (threads <= 1) {
+                for (int i = 0; i < item_count; i++)
+                    function(i);
+                return;
+            }
+
+            while ((int)workers.size() < threads - 1)
+                workers.emplace_back(&WorkerPool::work_loop, this, (int)workers.size());
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                call = &invoke<Function>;
+                context = &function;
+                count = item_count;
+                helpers = threads - 1;
+                busy = helpers;
+                next = 0;
+                generation++;
+            }
+            start_signal.notify_all();
+
+            for (int i = next++; i < item_count; i = next++)
+                function(i);
+
+            std::unique_lock<std::mutex> guard(lock);
+            done_signal.wait(guard, [&] { return busy == 0; });
+        }
+};
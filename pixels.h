@@ -0,0 +1,118 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    pixel conversions for captured frames
+
+    description:
+        captured frames are RGBA, bottom row first, either 32 bit float (the trail map) or 8 bit (the composed frame)
+        video and image files want top row first, so every conversion here also flips the rows
+        the inner loops are straight lines over contiguous rows with no branches, so the compiler can vectorize them
+*/
+
+/*
+    float_rows_to_rgb8 function
+
+    takes in RGBA float pixels, the size, and the RGB output (width * height * 3 bytes)
+
+    description:
+        clamps each channel to [0, 1] and rounds it to 8 bits, the alpha channel is dropped
+*/
+inline void float_rows_to_rgb8(const float* pixels, int width, int height, uint8_t* out) {
+    for (int y = 0; y < height; y++) {
+        const float* row = pixels + (size_t)(height - 1 - y) * width * 4;
+        uint8_t* out_row = out + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                float value = row[x * 4 + c];
+                value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+                out_row[x * 3 + c] = (uint8_t)(value * 255.0f + 0.5f);
+            }
+        }
+    }
+}
+
+/*
+    tone_map_rows_to_rgb8 function
+
+    takes in RGBA float pixels, the size, the tone curve strength and the RGB output (width * height * 3 bytes)
+
+    description:
+        maps each channel through v * (1 + k) / (1 + k * v), which keeps 0 at 0 and 1 at 1
+        a curve of 0 is the same as float_rows_to_rgb8, larger curves lift the faint trails and compress anything above 1
+*/
+inline void tone_map_rows_to_rgb8(const float* pixels, int width, int height, float curve, uint8_t* out) {
+    const float scale = (1.0f + curve) * 255.0f;
+    for (int y = 0; y < height; y++) {
+        const float* row = pixels + (size_t)(height - 1 - y) * width * 4;
+        uint8_t* out_row = out + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                float value = row[x * 4 + c];
+                value = value < 0.0f ? 0.0f : value;
+                value = value * scale / (1.0f + curve * value);
+                value = value > 255.0f ? 255.0f : value;
+                out_row[x * 3 + c] = (uint8_t)(value + 0.5f);
+            }
+        }
+    }
+}
+
+/*
+    byte_rows_to_rgb8 function
+
+    takes in RGBA 8 bit pixels, the size, and the RGB output (width * height * 3 bytes)
+*/
+inline void byte_rows_to_rgb8(const uint8_t* pixels, int width, int height, uint8_t* out) {
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = pixels + (size_t)(height - 1 - y) * width * 4;
+        uint8_t* out_row = out + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            out_row[x * 3 + 0] = row[x * 4 + 0];
+            out_row[x * 3 + 1] = row[x * 4 + 1];
+            out_row[x * 3 + 2] = row[x * 4 + 2];
+        }
+    }
+}
+
+/*
+    rgb8_to_yuv420 function
+
+    takes in top row first RGB pixels, the size, and the three output planes
+    the Y plane is width * height, the U and V planes are ((width + 1) / 2) * ((height + 1) / 2)
+
+    description:
+        BT.601 studio range, the same as the C420jpeg colour space in YUV4MPEG2 files
+        the chroma of each 2x2 block is the average of its pixels, odd edges reuse the last row or column
+*/
+inline void rgb8_to_yuv420(const uint8_t* rgb, int width, int height, uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane) {
+    // luma, one row at a time
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = rgb + (size_t)y * width * 3;
+        uint8_t* out_row = y_plane + (size_t)y * width;
+        for (int x = 0; x < width; x++) {
+            int r = row[x * 3 + 0], g = row[x * 3 + 1], b = row[x * 3 + 2];
+            out_row[x] = (uint8_t)((66 * r + 129 * g + 25 * b + 128 + (16 << 8)) >> 8);
+        }
+    }
+
+    // chroma, one 2x2 block at a time
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    for (int y = 0; y < chroma_height; y++) {
+        const uint8_t* row0 = rgb + (size_t)(2 * y) * width * 3;
+        const uint8_t* row1 = rgb + (size_t)(2 * y + 1 < height ? 2 * y + 1 : 2 * y) * width * 3;
+        uint8_t* u_row = u_plane + (size_t)y * chroma_width;
+        uint8_t* v_row = v_plane + (size_t)y * chroma_width;
+        for (int x = 0; x < chroma_width; x++) {
+            int x0 = 2 * x * 3;
+            int x1 = (2 * x + 1 < width ? 2 * x + 1 : 2 * x) * 3;
+            int r = (row0[x0 + 0] + row0[x1 + 0] + row1[x0 + 0] + row1[x1 + 0] + 2) >> 2;
+            int g = (row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1] + 2) >> 2;
+            int b = (row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2] + 2) >> 2;
+            u_row[x] = (uint8_t)((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+            v_row[x] = (uint8_t)((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <stddef.h>
+
+#define GLEW_STATIC
+#include <glew.h>
+
+/*
+    ReadbackBuffer struct (default public class)
+
+    description:
+        a buffer the gpu copies into and the cpu reads from without ever mapping or unmapping it again
+        the storage is persistently and coherently mapped, so once a fence placed after the copy has signaled
+        the mapped pointer can be read from any thread while the gl thread keeps going
+
+    member variables:
+        buffer
+        mapped
+        size
+*/
+struct ReadbackBuffer {
+    GLuint buffer = 0; // the gl buffer object
+    void* mapped = NULL; // the persistent mapping of the whole buffer
+    size_t size = 0; // the size of the buffer in bytes
+
+    ReadbackBuffer() {}
+    ReadbackBuffer(const ReadbackBuffer&) = delete;
+    ReadbackBuffer& operator=(const ReadbackBuffer&) = delete;
+
+    ~ReadbackBuffer() {
+        release();
+    }
+
+    /*
+        reserve function
+
+        takes in the number of bytes needed
+
+        description:
+            (re)allocates the buffer if it is smaller than the number of bytes needed, otherwise keeps it
+    */
+    void reserve(size_t bytes) {
+        if (buffer != 0 && size >= bytes)
+            return;
+        release();
+
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &buffer);
+        glNamedBufferStorage(buffer, (GLsizeiptr)bytes, NULL, flags | GL_CLIENT_STORAGE_BIT);
+        mapped = glMapNamedBufferRange(buffer, 0, (GLsizeiptr)bytes, flags);
+        size = bytes;
+    }
+
+    /*
+        release function
+
+        description:
+            unmaps and deletes the buffer, this has to run on the gl thread
+    */
+    void release() {
+        if (buffer == 0)
+            return;
+        glUnmapNamedBuffer(buffer);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        mapped = NULL;
+        size = 0;
+    }
+};
+
+/*
+    fence_signaled function
+
+    takes in a fence, or 0
+    returns true if there is no fence or the fence has signaled, never blocks
+*/
+inline bool fence_signaled(GLsync fence) {
+    if (fence == 0)
+        return true;
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+
+/*
+    counter based random numbers
+
+    description:
+        this is a Philox4x32-10 generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3")
+        instead of carrying state around, every random number is a pure function of a counter and a key
+        the counter is (agent id, step, stream, 0) and the key is the 64 bit simulation seed
+        so every agent gets its own independent stream that can be reproduced at any step
+
+        shaders/slime_mold.glsl has the exact same function, so both sides generate identical bits
+        the batched version works on several lanes at once and is written so the compiler can vectorize it
+*/
+
+// the streams keep the different uses of the generator from overlapping
+#define RNG_STREAM_AGENT 0u // used by the compute shader every step
+#define RNG_STREAM_SPAWN 1u // used when the agents are first placed
+#define RNG_STREAM_SWEEP 2u // used to pick the settings of the runs of a sweep
+#define RNG_STREAM_SEARCH 3u // used to draw the candidates of a parameter search
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+struct philox_key {
+    uint32_t k0;
+    uint32_t k1;
+};
+
+/*
+    make_philox_key function
+
+    takes in the 64 bit seed
+    returns the key split into two 32 bit halves, the same way it is stored in the settings SSBO
+*/
+inline philox_key make_philox_key(uint64_t seed) {
+    return { (uint32_t)(seed & 0xFFFFFFFFu), (uint32_t)(seed >> 32) };
+}
+
+/*
+    philox4x32 function
+
+    takes in the 4 counter words and the key
+    returns the 4 random words in place of the counter
+*/
+inline void philox4x32(uint32_t ctr[4], philox_key key) {
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+        uint64_t product0 = (uint64_t)PHILOX_M0 * ctr[0];
+        uint64_t product1 = (uint64_t)PHILOX_M1 * ctr[2];
+
+        uint32_t x0 = (uint32_t)(product1 >> 32) ^ ctr[1] ^ key.k0;
+        uint32_t x1 = (uint32_t)product1;
+        uint32_t x2 = (uint32_t)(product0 >> 32) ^ ctr[3] ^ key.k1;
+        uint32_t x3 = (uint32_t)product0;
+
+        ctr[0] = x0;
+        ctr[1] = x1;
+        ctr[2] = x2;
+        ctr[3] = x3;
+
+        key.k0 += PHILOX_W0;
+        key.k1 += PHILOX_W1;
+    }
+}
+
+/*
+    philox4x32_lanes function
+
+    takes in LANES counters laid out as [word][lane] and the key
+    returns the random words in place of the counters
+
+    description:
+        the same rounds as philox4x32, but every step runs across all the lanes
+        the inner loops have no dependencies between lanes, so 8 or 16 lanes end up in one vector register
+*/
+template <int LANES>
+inline void philox4x32_lanes(uint32_t ctr[4][LANES], philox_key key) {
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+        for (int lane = 0; lane < LANES; lane++) {
+            uint64_t product0 = (uint64_t)PHILOX_M0 * ctr[0][lane];
+            uint64_t product1 = (uint64_t)PHILOX_M1 * ctr[2][lane];
+
+            uint32_t x0 = (uint32_t)(product1 >> 32) ^ ctr[1][lane] ^ key.k0;
+            uint32_t x1 = (uint32_t)product1;
+            uint32_t x2 = (uint32_t)(product0 >> 32) ^ ctr[3][lane] ^ key.k1;
+            uint32_t x3 = (uint32_t)product0;
+
+            ctr[0][lane] = x0;
+            ctr[1][lane] = x1;
+            ctr[2][lane] = x2;
+            ctr[3][lane] = x3;
+        }
+
+        key.k0 += PHILOX_W0;
+        key.k1 += PHILOX_W1;
+    }
+}
+
+/*
+    rng_unit function
+
+    takes in a random word
+    returns a float in [0, 1)
+
+    description:
+        only the top 24 bits are used so the conversion is exact, which keeps it bit for bit equal to the shader
+*/
+inline float rng_unit(uint32_t state) {
+    return (float)(state >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "parallel.h"
+
+/*
+    summed area tables
+
+    description:
+        a summed area table holds, for every pixel, the sum of the sense values of every pixel below and left of it (itself included)
+        so the sum over any rectangle is four reads however big the rectangle is
+        the sense value of a pixel is the sum of its four channels, the same as sense_trail in slime_mold.glsl,
+        kept as fixed point with SAT_SCALE steps per unit
+
+        the sums are unsigned 32 bit and wrap around on large maps, the four reads of a rectangle still give its sum exactly
+        as long as the rectangle's own sum fits, which it does for any sensor footprint
+        this matches sat.glsl, which builds the same table on the gpu
+        the cpu engine builds one every step for the sensor footprints too big to be unrolled, see cpu_engine.h
+*/
+
+#define SAT_SCALE 4096.0f
+
+/*
+    sat_value function
+
+    takes in the sense value of one pixel, the sum of its four channels
+    returns it in fixed point
+*/
+inline uint32_t sat_value(float sense_value) {
+    return (uint32_t)(sense_value * SAT_SCALE + 0.5f);
+}
+
+/*
+    build_summed_area function
+
+    takes in the worker pool and the number of threads to build on (0 for every core), the size of the map,
+    a function taking a pixel's x and y and returning its sense value, and the table to fill (width * height entries)
+
+    description:
+        scans the rows in parallel, then the columns in parallel
+        the columns are scanned in strips of 64 so every thread walks the rows of the table in order
+*/
+template <typename SenseValue>
+void build_summed_area(WorkerPool& pool, int threads, int width, int height, SenseValue sense_value, uint32_t* table) {
+    pool.run(height, threads, [&](int y) {
+        uint32_t* out = table + (size_t)y * width;
+        uint32_t sum = 0;
+        for (int x = 0; x < width; x++) {
+            sum += sat_value(sense_value(x, y));
+            out[x] = sum;
+        }
+    });
+
+    const int strip_width = 64;
+    int strips = (width + strip_width - 1) / strip_width;
+    pool.run(strips, threads, [&](int strip) {
+        int start = strip * strip_width;
+        int end = std::min(width, start + strip_width);
+        for (int y = 1; y < height; y++) {
+            const uint32_t* above = table + (size_t)(y - 1) * width;
+            uint32_t* out = table + (size_t)y * width;
+            for (int x = start; x < end; x++)
+                out[x] += above[x];
+        }
+    });
+}
+
+/*
+    summed_area_sum function
+
+    takes in the table, the width of the map and the corners of a rectangle, both included and inside the map
+    returns the sum of the sense values inside the rectangle
+*/
+inline float summed_area_sum(const uint32_t* table, int width, int low_x, int low_y, int high_x, int high_y) {
+    uint32_t sum = table[(size_t)high_y * width + high_x];
+    if (low_x > 0)
+        sum -= table[(size_t)high_y * width + low_x - 1];
+    if (low_y > 0)
+        sum -= table[(size_t)(low_y - 1) * width + high_x];
+    if (low_x > 0 && low_y > 0)
+        sum += table[(size_t)(low_y - 1) * width + low_x - 1];
+    return (float)sum / SAT_SCALE;
+}
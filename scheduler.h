@@ -0,0 +1,213 @@
+#pragma once
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+/*
+    process_cpu_seconds function
+
+    returns the cpu time the whole process has used so far, in seconds
+
+    description:
+        std::clock is wall time on windows, so the process times are asked for directly there
+*/
+inline double process_cpu_seconds() {
+#ifdef _WIN32
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+        return 0;
+
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernel_time.dwLowDateTime;
+    kernel.HighPart = kernel_time.dwHighDateTime;
+    user.LowPart = user_time.dwLowDateTime;
+    user.HighPart = user_time.dwHighDateTime;
+    return (kernel.QuadPart + user.QuadPart) * 1e-7; // filetimes count 100ns ticks
+#else
+    return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// the numbers the scheduler reports once per report period
+struct scheduler_report {
+    double frames_per_second;
+    double steps_per_second;
+    double cpu_percent; // percent of one core used by the whole process
+    bool over_budget; // true if the cpu use went over the budget set in the settings
+};
+
+/*
+    FrameScheduler class
+
+    description:
+        decides how many simulation steps run before each presented frame
+        there are two modes:
+            steps_per_frame - a fixed number of steps, then the frame is presented ("present every N steps")
+            steps_per_second - steps are paid out from the elapsed time, no matter how often frames are presented
+        the second mode is used whenever steps_per_second is above 0
+
+        it also paces the loop, max_fps caps how often frames are presented and the caller
+        waits for events for the time the scheduler gives back instead of spinning
+        while the simulation is paused the loop only wakes up for events or the next report
+
+    member variables:
+        steps_per_frame
+        steps_per_second
+        max_steps_per_frame
+        frame_interval
+        cpu_budget
+        last_time
+        step_debt
+        next_frame_time
+        report_start, report_cpu, report_frames, report_steps
+*/
+class FrameScheduler {
+    private:
+        int steps_per_frame = 1; // the number of steps before each present in the fixed mode
+        double steps_per_second = 0; // the target step rate, 0 uses the fixed mode
+        int max_steps_per_frame = 1; // the most steps the timed mode will run before presenting, so a slow frame can't snowball
+
+        double frame_interval = 0; // the shortest time between presents, 0 doesn't cap the frame rate
+        double cpu_budget = 0; // the percent of one core the process is allowed, 0 doesn't report a budget
+
+        double last_time = -1; // the time the last frame started, negative until the first frame
+        double step_debt = 0; // the fraction of a step the timed mode still owes
+        double next_frame_time = 0; // the earliest time the next frame may start
+
+        // counters for the current report period
+        double report_start = -1;
+        double report_cpu = 0;
+        int report_frames = 0;
+        int report_steps = 0;
+
+    public:
+        static constexpr double report_period = 1.0; // seconds between reports
+        static constexpr double idle_timeout = 0.5; // the longest a paused loop sleeps between checks
+
+        /*
+            configure function
+
+            takes in the steps per frame, the target steps per second, the display refresh rate,
+            the frame rate cap and the cpu budget
+
+            description:
+                sets the mode of the scheduler, the refresh rate is only used to bound the catch up in the timed mode
+        */
+        void configure(int frame_steps, double second_steps, int refresh_rate, double max_fps, double budget) {
+            steps_per_frame = std::max(1, frame_steps);
+            steps_per_second = std::max(0.0, second_steps);
+
+            // let the timed mode catch up to 4 frames worth of steps at once
+            int refresh = refresh_rate > 0 ? refresh_rate : 60;
+            if (max_fps > 0)
+                refresh = std::min(refresh, (int)std::ceil(max_fps));
+            max_steps_per_frame = std::max(1, (int)std::ceil(4 * steps_per_second / refresh));
+
+            frame_interval = max_fps > 0 ? 1.0 / max_fps : 0;
+            cpu_budget = std::max(0.0, budget);
+            reset();
+        }
+
+        /*
+            reset function
+
+            description:
+                forgets the elapsed time, used when the simulation is unpaused so the paused time isn't paid out as steps
+        */
+        void reset() {
+            last_time = -1;
+            step_debt = 0;
+            next_frame_time = 0;
+        }
+
+        /*
+            steps_for_frame function
+
+            takes in the current time in seconds
+            returns the number of simulation steps to run before presenting
+        */
+        int steps_for_frame(double now) {
+            if (steps_per_second <= 0)
+                return steps_per_frame;
+
+            if (last_time < 0)
+                last_time = now;
+
+            step_debt += (now - last_time) * steps_per_second;
+            last_time = now;
+
+            int steps = std::min((int)step_debt, max_steps_per_frame);
+            step_debt = std::min(step_debt - steps, 1.0 * max_steps_per_frame);
+            return steps;
+        }
+
+        /*
+            end_frame function
+
+            takes in the current time in seconds and the number of steps the frame ran
+            returns the number of seconds the caller should wait for events before starting the next frame
+        */
+        double end_frame(double now, int steps) {
+            report_frames++;
+            report_steps += steps;
+
+            if (frame_interval <= 0)
+                return 0;
+
+            // schedule from the previous deadline so the rate doesn't drift, unless the frame ran late
+            next_frame_time = std::max(next_frame_time + frame_interval, now);
+            return next_frame_time - now;
+        }
+
+        /*
+            idle_wait function
+
+            takes in the current time in seconds
+            returns the number of seconds a paused loop should wait for events
+        */
+        double idle_wait(double now) {
+            if (report_start < 0)
+                return idle_timeout;
+            return std::max(0.0, std::min(idle_timeout, report_start + report_period - now));
+        }
+
+        /*
+            report function
+
+            takes in the current time in seconds and a report to fill in
+            returns true once per report period, when the report was filled in
+        */
+        bool report(double now, scheduler_report& out) {
+            double cpu = process_cpu_seconds();
+            if (report_start < 0) {
+                report_start = now;
+                report_cpu = cpu;
+                return false;
+            }
+
+            double elapsed = now - report_start;
+            if (elapsed < report_period)
+                return false;
+
+            out.frames_per_second = report_frames / elapsed;
+            out.steps_per_second = report_steps / elapsed;
+            out.cpu_percent = 100 * (cpu - report_cpu) / elapsed;
+            out.over_budget = cpu_budget > 0 && out.cpu_percent > cpu_budget;
+
+            report_start = now;
+            report_cpu = cpu;
+            report_frames = 0;
+            report_steps = 0;
+            return true;
+        }
+
+        double budget() const {
+            return cpu_budget;
+        }
+};
@@ -0,0 +1,458 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <json.hpp>
+
+#include "cpu_engine.h"
+#include "image_files.h"
+#include "metrics.h"
+#include "pixels.h"
+#include "rng.h"
+#include "snapshot.h"
+#include "sweep.h"
+
+/*
+    parameter search
+
+    description:
+        fits the settings a sweep can vary (see sweep.h) so a run's final trail map looks like a target
+        the target is either a reference snapshot, whose trail metrics (see metrics.h) the runs should match,
+        or the values of some of the metrics themselves
+        a pattern is never the same twice, so the runs are compared by their metrics and not pixel by pixel
+
+        the search is a separable CMA-ES (Ros and Hansen, "A Simple Modification in CMA-ES Achieving Linear Time and
+        Space Complexity"): every generation draws a population of candidates from a normal distribution, runs them,
+        and moves the mean towards the best half, growing or shrinking the step size and the spread of every setting
+        from how far the mean has been moving
+        every setting is searched in [0, 1] over its range, a candidate past the edge is run at the edge and pays for it
+
+        the candidates of a generation run in parallel, one engine per worker made once and restarted for every
+        candidate, so no buffer is allocated after the first generation
+        every candidate starts from the same agents with the same seed, so a setting always scores the same
+*/
+
+// everything a search file asks for
+struct search_spec {
+    std::vector<const sweep_parameter*> parameters;
+    std::vector<float> low; // the range of every parameter
+    std::vector<float> high;
+    std::vector<float> start; // where the mean starts, in [0, 1] over the range
+
+    std::vector<const trail_metric*> metrics; // the metrics that are matched
+    trail_metrics target;
+
+    int steps; // the steps every candidate runs
+    int generations; // the most generations the search runs
+    int population; // the candidates in a generation
+    float sigma; // the starting step size, in [0, 1] over the ranges
+    float tolerance; // the search stops once the step size is below this
+    uint64_t seed;
+    std::string results; // the directory the results go to
+};
+
+/*
+    read_search function
+
+    takes in the path to the search file, the settings file the search starts from and the spec to fill in
+    returns true if the file was read
+
+    description:
+        the search file sets "steps", "generations", "population" (0 picks from the number of settings), "sigma",
+        "tolerance", "seed" and "results", a [low, high] range in "ranges" for every setting it fits, and then either
+            "reference" - the path to a snapshot whose trail metrics are matched
+            "metrics" - the values of the metrics that are matched
+        the search starts from the settings file, moved inside the ranges
+        the file is read keeping its key order, so the settings are searched and reported in the order it lists them
+*/
+inline bool read_search(const char* path, const engine_settings& settings, search_spec& spec) {
+    std::ifstream fin(path);
+    if (!fin) {
+        fprintf(stderr, "Could not load the search file %s.\n", path);
+        return false;
+    }
+
+    nlohmann::ordered_json search_file;
+    fin >> search_file;
+
+    spec.steps = std::max(1, search_file.value("steps", 1000));
+    spec.generations = std::max(1, search_file.value("generations", 50));
+    spec.sigma = search_file.value("sigma", 0.3f);
+    spec.tolerance = search_file.value("tolerance", 1e-3f);
+    spec.seed = search_file.value("seed", (uint64_t)1);
+    spec.results = search_file.value("results", std::string("./search"));
+
+    spec.parameters.clear();
+    spec.low.clear();
+    spec.high.clear();
+    spec.start.clear();
+    nlohmann::ordered_json ranges = search_file.value("ranges", nlohmann::ordered_json::object());
+    for (auto range = ranges.begin(); range != ranges.end(); ++range) {
+        const sweep_parameter* parameter = find_sweep_parameter(range.key());
+        std::vector<float> bounds = range.value().get<std::vector<float>>();
+        if (!parameter || bounds.size() != 2 || !(bounds[1] > bounds[0])) {
+            fprintf(stderr, "The search can't fit %s like that, it is left out.\n", range.key().c_str());
+            continue;
+        }
+        float value = settings.*(parameter->field);
+        spec.parameters.push_back(parameter);
+        spec.low.push_back(bounds[0]);
+        spec.high.push_back(bounds[1]);
+        spec.start.push_back(std::min(std::max((value - bounds[0]) / (bounds[1] - bounds[0]), 0.0f), 1.0f));
+    }
+    if (spec.parameters.empty()) {
+        fprintf(stderr, "The search file needs a range for at least one setting.\n");
+        return false;
+    }
+
+    int dimensions = (int)spec.parameters.size();
+    spec.population = search_file.value("population", 0);
+    if (spec.population < 2)
+        spec.population = 4 + (int)(3 * std::log((double)dimensions));
+
+    // the target comes from the reference snapshot, or straight from the file
+    spec.metrics.clear();
+    spec.target = {};
+    if (search_file.contains("reference")) {
+        std::string reference = search_file["reference"];
+        MappedSnapshot snapshot;
+        if (!snapshot.open(reference.c_str()))
+            return false;
+        const snapshot_header& header = *snapshot.header;
+        if (header.trail_format != ENGINE_SNAPSHOT_FORMAT || header.trail.size != (uint64_t)header.width * header.height * 4 * sizeof(float)) {
+            fprintf(stderr, "The reference snapshot %s doesn't hold a float trail map.\n", reference.c_str());
+            return false;
+        }
+        spec.target = measure_trail((const float*)snapshot.trail(), header.width, header.height);
+        for (const trail_metric& metric : trail_metric_list())
+            spec.metrics.push_back(&metric);
+    } else {
+        nlohmann::ordered_json metrics = search_file.value("metrics", nlohmann::ordered_json::object());
+        for (const trail_metric& metric : trail_metric_list()) {
+            if (metrics.contains(metric.name)) {
+                spec.target.*(metric.field) = metrics[metric.name].get<float>();
+                spec.metrics.push_back(&metric);
+            }
+        }
+    }
+    if (spec.metrics.empty()) {
+        fprintf(stderr, "The search file needs a \"reference\" snapshot or some \"metrics\" to match.\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+    search_loss function
+
+    takes in the spec and the metrics of a run
+    returns how far the run is from the target, the sum of the squared relative differences of the matched metrics
+*/
+inline float search_loss(const search_spec& spec, const trail_metrics& metrics) {
+    float loss = 0;
+    for (const trail_metric* metric : spec.metrics) {
+        float target = spec.target.*(metric->field);
+        float difference = (metrics.*(metric->field) - target) / std::max(std::fabs(target), 1e-3f);
+        loss += difference * difference;
+    }
+    return loss;
+}
+
+/*
+    SearchWorker struct
+
+    description:
+        the engine and the trail buffer one worker runs its candidates in, made once for the whole search
+*/
+struct SearchWorker {
+    std::unique_ptr<Engine> engine;
+    std::vector<float> trail;
+};
+
+/*
+    ParameterSearch class
+
+    description:
+        the state of a separable CMA-ES over the spec's settings, see the top of this file
+
+    member variables:
+        spec, base, agents, threads
+        mean, sigma, variance, path_sigma, path_variance, weights, mu_effective
+        workers
+        best_loss, best_values, best_trail
+*/
+class ParameterSearch {
+    private:
+        const search_spec& spec;
+        engine_run base; // the run every candidate starts from
+        std::vector<engine_agent> agents; // spawned once, every candidate starts from these
+        int threads; // the cores the candidates are spread over
+
+        // the distribution the candidates are drawn from, in [0, 1] over the ranges
+        std::vector<double> mean;
+        double sigma;
+        std::vector<double> variance; // the spread of every setting, the diagonal of the covariance
+        std::vector<double> path_sigma; // where the mean has been going, for the step size
+        std::vector<double> path_variance; // where the mean has been going, for the spread
+        std::vector<double> weights; // the weight of each of the best half of a generation
+        double mu_effective;
+
+        std::vector<SearchWorker> workers;
+
+        float best_loss = INFINITY; // the best candidate so far
+        std::vector<float> best_values;
+        std::vector<float> best_trail;
+
+        // the run of a candidate, its settings moved from [0, 1] onto their ranges
+        engine_settings candidate_settings(const std::vector<double>& point) const {
+            engine_settings settings = base.settings;
+            for (size_t i = 0; i < spec.parameters.size(); i++) {
+                double clamped = std::min(std::max(point[i], 0.0), 1.0);
+                settings.*(spec.parameters[i]->field) = (float)(spec.low[i] + clamped * (spec.high[i] - spec.low[i]));
+            }
+            return settings;
+        }
+
+        // a standard normal number, the counter is (generation, candidate, stream, setting) so a search can be repeated
+        double normal(int generation, int candidate, int setting) const {
+            uint32_t random[4] = { (uint32_t)generation, (uint32_t)candidate, RNG_STREAM_SEARCH, (uint32_t)setting };
+            philox4x32(random, make_philox_key(spec.seed));
+            double u1 = (random[0] + 1.0) / 4294967296.0; // (0, 1], so the log is finite
+            double u2 = random[1] / 4294967296.0;
+            return std::sqrt(-2 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+        }
+
+        /*
+            evaluate function
+
+            takes in the candidates and their losses to fill in
+
+            description:
+                runs the candidates over the workers, each worker takes the next candidate until none are left
+        */
+        void evaluate(const std::vector<std::vector<double>>& candidates, std::vector<float>& losses) {
+            std::atomic<int> next(0);
+            std::mutex best_lock;
+            auto work = [&](int worker_index) {
+                SearchWorker& worker = workers[worker_index];
+                for (int i = next++; i < (int)candidates.size(); i = next++) {
+                    engine_settings settings = candidate_settings(candidates[i]);
+                    worker.engine->restart(settings, agents);
+                    for (int step = 0; step < spec.steps; step++)
+                        worker.engine->step(false);
+                    worker.engine->read_trail(worker.trail.data());
+
+                    // a candidate past the edge of a range pays for how far past it is
+                    float loss = search_loss(spec, measure_trail(worker.trail.data(), settings.width, settings.height));
+                    for (size_t setting = 0; setting < mean.size(); setting++) {
+                        double outside = candidates[i][setting] - std::min(std::max(candidates[i][setting], 0.0), 1.0);
+                        loss += (float)(outside * outside);
+                    }
+                    losses[i] = loss;
+
+                    std::lock_guard<std::mutex> lock(best_lock);
+                    if (loss < best_loss) {
+                        best_loss = loss;
+                        for (size_t setting = 0; setting < best_values.size(); setting++)
+                            best_values[setting] = settings.*(spec.parameters[setting]->field);
+                        std::copy(worker.trail.begin(), worker.trail.end(), best_trail.begin());
+                    }
+                }
+            };
+
+            std::vector<std::thread> helpers;
+            for (int i = 1; i < (int)workers.size(); i++)
+                helpers.emplace_back(work, i);
+            work(0);
+            for (std::thread& helper : helpers)
+                helper.join();
+        }
+
+    public:
+        /*
+            ParameterSearch constructor
+
+            takes in the spec and the run read from the settings file
+        */
+        ParameterSearch(const search_spec& search, const engine_run& run) : spec(search), base(run) {
+            int dimensions = (int)spec.parameters.size();
+            mean.assign(spec.start.begin(), spec.start.end());
+            sigma = spec.sigma;
+            variance.assign(dimensions, 1.0);
+            path_sigma.assign(dimensions, 0.0);
+            path_variance.assign(dimensions, 0.0);
+
+            // the best half of a generation moves the mean, the better ones more
+            int mu = spec.population / 2;
+            double weight_sum = 0, square_sum = 0;
+            for (int i = 0; i < mu; i++) {
+                weights.push_back(std::log(mu + 0.5) - std::log(i + 1.0));
+                weight_sum += weights.back();
+            }
+            for (double& weight : weights) {
+                weight /= weight_sum;
+                square_sum += weight * weight;
+            }
+            mu_effective = 1 / square_sum;
+
+            agents.resize(base.agent_count);
+            spawn_agents(agents.data(), base.agent_count, base.spawn_method, base.settings.width, base.settings.height, base.seed);
+
+            // a worker for every candidate up to the core count, and the cores left over split between them
+            threads = base.threads > 0 ? base.threads : (int)std::thread::hardware_concurrency();
+            int worker_count = std::max(1, std::min(threads, spec.population));
+            workers.resize(worker_count);
+            size_t channels = (size_t)base.settings.width * base.settings.height * 4;
+            for (SearchWorker& worker : workers) {
+                worker.engine.reset(make_engine(base.kernels, base.settings, agents, std::max(1, threads / worker_count), 0));
+                worker.trail.resize(channels);
+            }
+            best_values.resize(dimensions);
+            best_trail.resize(channels);
+        }
+
+        /*
+            run function
+
+            returns true if the results were written
+
+            description:
+                runs generations until the step size drops below the tolerance or the generations run out
+                prints every generation and writes convergence.csv, then the best candidate's settings.json and trail
+        */
+        bool run() {
+            make_results_directory(spec.results);
+            int dimensions = (int)mean.size();
+            int mu = (int)weights.size();
+
+            // the learning rates of the separable CMA-ES, the spread rates are scaled up by (n + 2) / 3
+            double c_sigma = (mu_effective + 2) / (dimensions + mu_effective + 5);
+            double d_sigma = 1 + 2 * std::max(0.0, std::sqrt((mu_effective - 1) / (dimensions + 1)) - 1) + c_sigma;
+            double c_path = (4 + mu_effective / dimensions) / (dimensions + 4 + 2 * mu_effective / dimensions);
+            double c_one = 2 / ((dimensions + 1.3) * (dimensions + 1.3) + mu_effective);
+            double c_mu = std::min(1 - c_one, 2 * (mu_effective - 2 + 1 / mu_effective) / ((dimensions + 2) * (dimensions + 2) + mu_effective));
+            c_one = std::min(1.0, c_one * (dimensions + 2) / 3);
+            c_mu = std::min(1 - c_one, c_mu * (dimensions + 2) / 3);
+            double expected_length = std::sqrt((double)dimensions) * (1 - 1.0 / (4 * dimensions) + 1.0 / (21.0 * dimensions * dimensions));
+
+            std::string csv = "generation,best,mean,sigma,seconds";
+            for (const sweep_parameter* parameter : spec.parameters)
+                csv += std::string(",") + parameter->name;
+            csv += "\n";
+
+            std::vector<std::vector<double>> steps(spec.population, std::vector<double>(dimensions));
+            std::vector<std::vector<double>> candidates(spec.population, std::vector<double>(dimensions));
+            std::vector<float> losses(spec.population);
+            std::vector<int> order(spec.population);
+            auto start = std::chrono::steady_clock::now();
+
+            for (int generation = 0; generation < spec.generations && sigma >= spec.tolerance; generation++) {
+                for (int i = 0; i < spec.population; i++) {
+                    for (int setting = 0; setting < dimensions; setting++) {
+                        steps[i][setting] = std::sqrt(variance[setting]) * normal(generation, i, setting);
+                        candidates[i][setting] = mean[setting] + sigma * steps[i][setting];
+                    }
+                }
+                evaluate(candidates, losses);
+
+                for (int i = 0; i < spec.population; i++)
+                    order[i] = i;
+                std::sort(order.begin(), order.end(), [&](int a, int b) { return losses[a] < losses[b]; });
+
+                // the mean moves to the weighted best half, the step it took is what the paths follow
+                std::vector<double> mean_step(dimensions, 0.0);
+                for (int i = 0; i < mu; i++) {
+                    for (int setting = 0; setting < dimensions; setting++)
+                        mean_step[setting] += weights[i] * steps[order[i]][setting];
+                }
+
+                double path_length = 0;
+                for (int setting = 0; setting < dimensions; setting++) {
+                    mean[setting] += sigma * mean_step[setting];
+                    path_sigma[setting] = (1 - c_sigma) * path_sigma[setting] +
+                        std::sqrt(c_sigma * (2 - c_sigma) * mu_effective) * mean_step[setting] / std::sqrt(variance[setting]);
+                    path_length += path_sigma[setting] * path_sigma[setting];
+                }
+                path_length = std::sqrt(path_length);
+
+                // the spread path stalls while the step size path is long, so a fast growing step doesn't blow up the spread
+                bool stalled = path_length / std::sqrt(1 - std::pow(1 - c_sigma, 2.0 * (generation + 1))) >=
+                    (1.4 + 2.0 / (dimensions + 1)) * expected_length;
+                for (int setting = 0; setting < dimensions; setting++) {
+                    path_variance[setting] = (1 - c_path) * path_variance[setting] +
+                        (stalled ? 0.0 : std::sqrt(c_path * (2 - c_path) * mu_effective)) * mean_step[setting];
+
+                    double rank_mu = 0;
+                    for (int i = 0; i < mu; i++)
+                        rank_mu += weights[i] * steps[order[i]][setting] * steps[order[i]][setting];
+                    variance[setting] = (1 - c_one - c_mu) * variance[setting] +
+                        c_one * (path_variance[setting] * path_variance[setting] + (stalled ? c_path * (2 - c_path) * variance[setting] : 0.0)) +
+                        c_mu * rank_mu;
+                }
+                sigma *= std::exp(c_sigma / d_sigma * (path_length / expected_length - 1));
+
+                // report the generation
+                double loss_mean = 0;
+                for (float loss : losses)
+                    loss_mean += loss / spec.population;
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                fprintf(stderr, "generation %d: best %g, generation best %g, mean %g, sigma %g, %.1f s\n",
+                    generation, best_loss, losses[order[0]], loss_mean, sigma, seconds);
+
+                char line[64];
+                snprintf(line, sizeof(line), "%d,%g,%g,%g,%.3f", generation, best_loss, loss_mean, sigma, seconds);
+                csv += line;
+                for (float value : best_values) {
+                    snprintf(line, sizeof(line), ",%g", value);
+                    csv += line;
+                }
+                csv += "\n";
+                if (!write_sweep_file(spec.results + "/convergence.csv", csv.data(), csv.size()))
+                    return false;
+            }
+            return write_best();
+        }
+
+        /*
+            write_best function
+
+            returns true if the best candidate's settings.json and trail were written
+
+            description:
+                the settings.json is the one the search started from with the fitted settings put in, in the same key order
+        */
+        bool write_best() const {
+            std::ifstream fin("./settings.json");
+            nlohmann::ordered_json settings_file;
+            if (fin)
+                fin >> settings_file;
+            for (size_t i = 0; i < spec.parameters.size(); i++)
+                settings_file[spec.parameters[i]->name] = best_values[i];
+            std::string text = settings_file.dump(2);
+
+            int width = base.settings.width;
+            int height = base.settings.height;
+            std::vector<uint8_t> rgb((size_t)width * height * 3);
+            std::vector<uint8_t> png;
+            float_rows_to_rgb8(best_trail.data(), width, height, rgb.data());
+            encode_png(rgb.data(), width, height, png);
+
+            fprintf(stderr, "best loss %g:", best_loss);
+            for (size_t i = 0; i < spec.parameters.size(); i++)
+                fprintf(stderr, " %s %g", spec.parameters[i]->name, best_values[i]);
+            fprintf(stderr, "\n");
+            return write_sweep_file(spec.results + "/settings.json", text.data(), text.size()) &&
+                write_sweep_file(spec.results + "/best.png", png.data(), png.size());
+        }
+};
@@ -0,0 +1,796 @@
+#pragma once
+#include <math.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "parallel.h"
+#include "snapshot.h"
+
+/*
+    series file format
+
+    description:
+        a series is a long run of snapshots in one file, made small enough to record every few steps
+        the file starts with a series_header and the settings block, then every record is appended as it is taken
+
+        | series_header | settings | series_record | chunk sizes | chunks | series_record | ...
+
+        agents are quantized (positions to 1/16 of a pixel, headings to 1/4096 of a turn) and stored as the difference
+        from the record before, and between two saves an agent only moves a few pixels, so the differences are small.
+        they are bit packed in blocks of 256 agents, every field of a block only takes as many bits as its largest value
+        the trail map is quantized to 12 bits per channel and stored as the difference from the record before
+        (so the steady decay turns into long runs of one value), green and blue are stored as the difference from
+        the channel before (so a single colour costs about one channel), then every plane is run length encoded
+
+        every keyframe_every records a keyframe is stored against zero instead, so a reader can start from any keyframe
+        the differences are chained from one record to the next and not taken against the keyframe, so to get to a
+        record a reader has to decode the keyframe before it and every record in between, up to keyframe_every records
+
+        the agents and the trail are cut into chunks that are encoded and decoded on separate threads,
+        the size of each chunk is written before the chunks so a reader can find them all up front
+*/
+
+#define SERIES_MAGIC "SLIMSERS"
+#define SERIES_VERSION 1
+
+#define SERIES_POSITION_SCALE 16.0f // quantization steps per pixel
+#define SERIES_ANGLE_STEPS 4096 // quantization steps per turn
+#define SERIES_TRAIL_STEPS 4095.0f // quantization steps between 0 and 1
+
+#define SERIES_AGENTS_PER_CHUNK 65536
+#define SERIES_AGENTS_PER_BLOCK 256
+#define SERIES_ROWS_PER_CHUNK 64
+#define SERIES_MIN_REPEAT 4 // the shortest run worth storing as a repeat
+
+#define SERIES_KEYFRAME 1u // series_record flag
+
+struct series_header {
+    char magic[8]; // SERIES_MAGIC, without the null terminator
+    uint32_t version; // SERIES_VERSION
+    uint32_t endian_check; // SNAPSHOT_ENDIAN_CHECK
+    uint32_t header_size; // sizeof(series_header)
+
+    int32_t width;
+    int32_t height;
+    int32_t agent_count;
+    uint32_t agent_size; // bytes per agent, anything after the position and heading is stored as is
+    uint32_t keyframe_every; // records between keyframes
+    uint32_t agents_per_chunk;
+    uint32_t rows_per_chunk;
+    uint32_t settings_size; // bytes of settings block after the header
+    uint32_t reserved;
+    uint64_t seed;
+
+    uint64_t header_checksum; // snapshot_checksum of every byte above this one
+};
+
+struct series_record {
+    uint32_t flags; // SERIES_KEYFRAME
+    uint32_t chunk_count; // agent chunks followed by trail chunks
+    uint64_t step;
+    uint64_t payload_size; // bytes of chunk sizes and chunks after this record
+    uint64_t payload_checksum; // see series_payload_checksum
+};
+
+/*
+    series_payload_checksum function
+
+    takes in the chunk sizes and a pointer to each chunk
+    returns the checksum of the record payload
+
+    description:
+        chains the checksum of every chunk, so the chunks never have to be joined into one buffer to be checked
+*/
+inline uint64_t series_payload_checksum(const uint32_t* sizes, const uint8_t* const* chunks, uint32_t chunk_count) {
+    uint64_t checksum = snapshot_checksum(sizes, chunk_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < chunk_count; i++)
+        checksum = (checksum * 0x100000001B3ull) ^ snapshot_checksum(chunks[i], sizes[i]);
+    return checksum;
+}
+
+/*
+    varint and zigzag helpers
+
+    description:
+        unsigned values are written 7 bits a byte, low bits first, with the top bit set on every byte but the last
+        signed values are zigzag mapped first (0, -1, 1, -2, ...) so small differences of either sign stay small
+*/
+inline void series_put_varint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+// returns false instead of reading past the end
+inline bool series_get_varint(const uint8_t*& cursor, const uint8_t* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && cursor < end; shift += 7) {
+        uint8_t byte = *cursor++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+inline uint32_t series_zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t series_unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/*
+    series_pack_bits function
+
+    takes in some values, how many there are, and the output
+
+    description:
+        writes one byte with the bit width of the largest value, then every value in that many bits, low bits first
+        when most of the values are zero (agents that went straight keep their heading) the top bit of that byte is set,
+        and a bitmap of which values aren't zero comes first, then only the values that aren't zero
+        a block of zeros costs the one byte
+*/
+inline void series_pack_bits(const uint32_t* values, int count, std::vector<uint8_t>& out) {
+    uint32_t largest = 0;
+    int nonzero = 0;
+    for (int i = 0; i < count; i++) {
+        largest |= values[i];
+        nonzero += values[i] != 0;
+    }
+    int bits = 0;
+    while (bits < 32 && (largest >> bits) != 0)
+        bits++;
+
+    size_t dense = ((size_t)count * bits + 7) / 8;
+    size_t sparse = ((size_t)count + 7) / 8 + ((size_t)nonzero * bits + 7) / 8;
+    bool use_bitmap = bits > 0 && sparse < dense;
+    out.push_back((uint8_t)(bits | (use_bitmap ? 0x80 : 0)));
+
+    if (use_bitmap) {
+        for (int i = 0; i < count; i += 8) {
+            uint8_t flags = 0;
+            for (int j = i; j < count && j < i + 8; j++)
+                flags |= (uint8_t)((values[j] != 0) << (j - i));
+            out.push_back(flags);
+        }
+    }
+
+    uint64_t buffer = 0;
+    int buffered = 0;
+    for (int i = 0; i < count && bits > 0; i++) {
+        if (use_bitmap && values[i] == 0)
+            continue;
+        buffer |= (uint64_t)values[i] << buffered;
+        buffered += bits;
+        while (buffered >= 8) {
+            out.push_back((uint8_t)buffer);
+            buffer >>= 8;
+            buffered -= 8;
+        }
+    }
+    if (buffered > 0)
+        out.push_back((uint8_t)buffer);
+}
+
+// returns false if the block runs past the end or the width is not a bit width
+inline bool series_unpack_bits(const uint8_t*& cursor, const uint8_t* end, int count, uint32_t* values) {
+    if (cursor >= end)
+        return false;
+    int bits = *cursor & 0x7F;
+    bool use_bitmap = (*cursor++ & 0x80) != 0;
+    if (bits > 32)
+        return false;
+
+    // with a bitmap, a value is only stored where its flag is set
+    const uint8_t* flags = cursor;
+    int stored = count;
+    if (use_bitmap) {
+        size_t flag_bytes = ((size_t)count + 7) / 8;
+        if ((size_t)(end - cursor) < flag_bytes)
+            return false;
+        stored = 0;
+        for (int i = 0; i < count; i++)
+            stored += (flags[i / 8] >> (i % 8)) & 1;
+        cursor += flag_bytes;
+    }
+
+    size_t bytes = ((size_t)stored * bits + 7) / 8;
+    if ((size_t)(end - cursor) < bytes)
+        return false;
+
+    uint64_t buffer = 0;
+    int buffered = 0;
+    const uint64_t mask = bits == 32 ? 0xFFFFFFFFull : ((1ull << bits) - 1);
+    for (int i = 0; i < count; i++) {
+        if (use_bitmap && !((flags[i / 8] >> (i % 8)) & 1)) {
+            values[i] = 0;
+            continue;
+        }
+        while (buffered < bits) {
+            buffer |= (uint64_t)*cursor++ << buffered;
+            buffered += 8;
+        }
+        values[i] = (uint32_t)(buffer & mask);
+        buffer = bits == 0 ? buffer : buffer >> bits;
+        buffered -= bits;
+    }
+    return true;
+}
+
+/*
+    quantization helpers
+
+    description:
+        the heading is wrapped to one turn as it is quantized, which doesn't change where the agent points
+*/
+inline int32_t series_quantize_position(float value) {
+    return (int32_t)lrintf(value * SERIES_POSITION_SCALE);
+}
+
+inline uint32_t series_quantize_angle(float value) {
+    return (uint32_t)(int64_t)floor((double)value * (SERIES_ANGLE_STEPS / 6.283185307179586) + 0.5) & (SERIES_ANGLE_STEPS - 1);
+}
+
+inline uint16_t series_quantize_trail(float value) {
+    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+    return (uint16_t)(value * SERIES_TRAIL_STEPS + 0.5f);
+}
+
+/*
+    series_reference struct
+
+    description:
+        the quantized state of the record before, every record but a keyframe is stored against it
+*/
+struct series_reference {
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+    std::vector<uint32_t> angle;
+    std::vector<uint16_t> trail; // RGBA, the same layout as the trail map
+
+    void resize(int agent_count, int width, int height) {
+        x.assign(agent_count, 0);
+        y.assign(agent_count, 0);
+        angle.assign(agent_count, 0);
+        trail.assign((size_t)width * height * 4, 0);
+    }
+};
+
+/*
+    encode_series_agents function
+
+    takes in the agents, the agent size, the range of agents in the chunk, the reference, whether this is a keyframe
+    and the output chunk
+
+    description:
+        a keyframe is stored against zero, anything else against the reference, and the reference is updated either way
+        each block is the packed x differences, the packed y differences, the packed heading differences,
+        then the bytes after the heading of each agent as they are
+*/
+inline void encode_series_agents(const uint8_t* agents, uint32_t agent_size, int first, int last,
+    series_reference& reference, bool keyframe, std::vector<uint8_t>& out) {
+    out.clear();
+    const size_t tail = agent_size - 3 * sizeof(float);
+    uint32_t fields[3][SERIES_AGENTS_PER_BLOCK];
+
+    for (int block = first; block < last; block += SERIES_AGENTS_PER_BLOCK) {
+        int count = last - block < SERIES_AGENTS_PER_BLOCK ? last - block : SERIES_AGENTS_PER_BLOCK;
+        for (int j = 0; j < count; j++) {
+            int i = block + j;
+            float agent[3];
+            memcpy(agent, agents + (size_t)i * agent_size, sizeof(agent));
+
+            int32_t x = series_quantize_position(agent[0]);
+            int32_t y = series_quantize_position(agent[1]);
+            uint32_t angle = series_quantize_angle(agent[2]);
+
+            int32_t angle_change = (int32_t)((angle - (keyframe ? 0 : reference.angle[i])) & (SERIES_ANGLE_STEPS - 1));
+            if (angle_change >= SERIES_ANGLE_STEPS / 2)
+                angle_change -= SERIES_ANGLE_STEPS; // the short way round
+            fields[0][j] = series_zigzag(x - (keyframe ? 0 : reference.x[i]));
+            fields[1][j] = series_zigzag(y - (keyframe ? 0 : reference.y[i]));
+            fields[2][j] = series_zigzag(angle_change);
+
+            reference.x[i] = x;
+            reference.y[i] = y;
+            reference.angle[i] = angle;
+        }
+
+        for (int field = 0; field < 3; field++)
+            series_pack_bits(fields[field], count, out);
+        for (int j = 0; j < count && tail > 0; j++) {
+            const uint8_t* extra = agents + (size_t)(block + j) * agent_size + 3 * sizeof(float);
+            out.insert(out.end(), extra, extra + tail);
+        }
+    }
+}
+
+/*
+    decode_series_agents function
+
+    takes in the chunk, the agent size, the range of agents in the chunk, the reference, whether this is a keyframe
+    and the agents to write
+    returns false if the chunk is malformed
+*/
+inline bool decode_series_agents(const uint8_t* cursor, const uint8_t* end, uint32_t agent_size, int first, int last,
+    series_reference& reference, bool keyframe, uint8_t* agents) {
+    const size_t tail = agent_size - 3 * sizeof(float);
+    uint32_t fields[3][SERIES_AGENTS_PER_BLOCK];
+
+    for (int block = first; block < last; block += SERIES_AGENTS_PER_BLOCK) {
+        int count = last - block < SERIES_AGENTS_PER_BLOCK ? last - block : SERIES_AGENTS_PER_BLOCK;
+        for (int field = 0; field < 3; field++) {
+            if (!series_unpack_bits(cursor, end, count, fields[field]))
+                return false;
+        }
+        if ((size_t)(end - cursor) < tail * count)
+            return false;
+
+        for (int j = 0; j < count; j++) {
+            int i = block + j;
+            int32_t x = series_unzigzag(fields[0][j]) + (keyframe ? 0 : reference.x[i]);
+            int32_t y = series_unzigzag(fields[1][j]) + (keyframe ? 0 : reference.y[i]);
+            uint32_t angle = ((uint32_t)series_unzigzag(fields[2][j]) + (keyframe ? 0 : reference.angle[i])) & (SERIES_ANGLE_STEPS - 1);
+            reference.x[i] = x;
+            reference.y[i] = y;
+            reference.angle[i] = angle;
+
+            float agent[3] = { x / SERIES_POSITION_SCALE, y / SERIES_POSITION_SCALE,
+                (float)(angle * (6.283185307179586 / SERIES_ANGLE_STEPS)) };
+            uint8_t* out = agents + (size_t)i * agent_size;
+            memcpy(out, agent, sizeof(agent));
+            memcpy(out + sizeof(agent), cursor, tail);
+            cursor += tail;
+        }
+    }
+    return cursor == end;
+}
+
+/*
+    encode_series_trail function
+
+    takes in the RGBA float trail map, its width, the range of rows in the chunk, the reference, whether this is a keyframe,
+    a scratch plane and the output chunk
+
+    description:
+        each of the four planes is stored one after the other as a run of tokens
+        a token starts with a varint of (length << 1 | repeat)
+        a repeat is followed by the repeated value, a literal run by the difference of each value from the one before it
+        all the arithmetic is on 16 bit values that wrap, so the decoder undoes every difference exactly
+*/
+inline void encode_series_trail(const float* trail, int width, int first_row, int last_row,
+    series_reference& reference, bool keyframe, std::vector<uint16_t>& plane, std::vector<uint8_t>& out) {
+    out.clear();
+    const size_t first = (size_t)first_row * width;
+    const size_t count = (size_t)(last_row - first_row) * width;
+    plane.resize(count * 4);
+
+    // difference from the reference, then from the channel before, one pixel at a time
+    for (size_t i = 0; i < count; i++) {
+        uint16_t change[4];
+        for (int channel = 0; channel < 4; channel++) {
+            uint16_t value = series_quantize_trail(trail[(first + i) * 4 + channel]);
+            uint16_t& previous = reference.trail[(first + i) * 4 + channel];
+            change[channel] = (uint16_t)(value - (keyframe ? 0 : previous));
+            previous = value;
+        }
+        plane[i] = change[0];
+        plane[count + i] = (uint16_t)(change[1] - change[0]);
+        plane[2 * count + i] = (uint16_t)(change[2] - change[1]);
+        plane[3 * count + i] = change[3];
+    }
+
+    for (int channel = 0; channel < 4; channel++) {
+        const uint16_t* values = plane.data() + channel * count;
+        uint16_t previous = 0;
+        size_t literal_start = 0;
+        size_t i = 0;
+        while (i < count) {
+            size_t run = 1;
+            while (i + run < count && values[i + run] == values[i])
+                run++;
+            if (run < SERIES_MIN_REPEAT && i + run < count) {
+                i += run;
+                continue;
+            }
+
+            // a literal run covers everything since the last repeat
+            size_t literal_end = run >= SERIES_MIN_REPEAT ? i : count;
+            if (literal_end > literal_start) {
+                series_put_varint(out, (uint32_t)(literal_end - literal_start) << 1);
+                for (size_t j = literal_start; j < literal_end; j++) {
+                    series_put_varint(out, series_zigzag((int16_t)(uint16_t)(values[j] - previous)));
+                    previous = values[j];
+                }
+            }
+            if (run >= SERIES_MIN_REPEAT) {
+                series_put_varint(out, ((uint32_t)run << 1) | 1);
+                series_put_varint(out, values[i]);
+                previous = values[i];
+            }
+            i += run;
+            literal_start = i;
+        }
+    }
+}
+
+/*
+    decode_series_trail function
+
+    takes in the chunk, the width, the range of rows in the chunk, the reference, whether this is a keyframe,
+    a scratch plane and the RGBA float trail map to write
+    returns false if the chunk is malformed
+*/
+inline bool decode_series_trail(const uint8_t* cursor, const uint8_t* end, int width, int first_row, int last_row,
+    series_reference& reference, bool keyframe, std::vector<uint16_t>& plane, float* trail) {
+    const size_t first = (size_t)first_row * width;
+    const size_t count = (size_t)(last_row - first_row) * width;
+    plane.resize(count * 4);
+
+    for (int channel = 0; channel < 4; channel++) {
+        uint16_t* values = plane.data() + channel * count;
+        uint16_t previous = 0;
+        size_t i = 0;
+        while (i < count) {
+            uint32_t token;
+            if (!series_get_varint(cursor, end, token))
+                return false;
+            size_t run = token >> 1;
+            if (run == 0 || run > count - i)
+                return false;
+
+            if (token & 1) {
+                uint32_t value;
+                if (!series_get_varint(cursor, end, value))
+                    return false;
+                previous = (uint16_t)value;
+                for (size_t j = 0; j < run; j++)
+                    values[i + j] = previous;
+            } else {
+                for (size_t j = 0; j < run; j++) {
+                    uint32_t delta;
+                    if (!series_get_varint(cursor, end, delta))
+                        return false;
+                    previous = (uint16_t)(previous + series_unzigzag(delta));
+                    values[i + j] = previous;
+                }
+            }
+            i += run;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint16_t change[4];
+        change[0] = plane[i];
+        change[1] = (uint16_t)(plane[count + i] + change[0]);
+        change[2] = (uint16_t)(plane[2 * count + i] + change[1]);
+        change[3] = plane[3 * count + i];
+        for (int channel = 0; channel < 4; channel++) {
+            uint16_t& previous = reference.trail[(first + i) * 4 + channel];
+            previous = (uint16_t)(change[channel] + (keyframe ? 0 : previous));
+            trail[(first + i) * 4 + channel] = previous / SERIES_TRAIL_STEPS;
+        }
+    }
+    return cursor == end;
+}
+
+/*
+    SeriesWriter class
+
+    description:
+        appends compressed snapshots to a series file
+        the file is created on the first append, so it takes the size of the simulation at that point
+        append is meant to be called from a Checkpointer writer thread, the chunks are encoded on a thread pool
+
+    member variables:
+        path, output
+        header
+        keyframe_every, threads
+        reference, records
+        chunks, planes
+        raw_bytes, written_bytes
+*/
+class SeriesWriter {
+    private:
+        std::string path;
+        FILE* output = NULL;
+        series_header header;
+        bool failed = false;
+
+        int keyframe_every; // records between keyframes
+        int threads; // encoder threads, 0 for every core
+
+        series_reference reference; // the record before, what the next record is stored against
+        long long records = 0; // records appended so far
+
+        // one output buffer and one plane buffer per chunk, kept between records so nothing is reallocated
+        std::vector<std::vector<uint8_t>> chunks;
+        std::vector<std::vector<uint16_t>> planes;
+
+        uint64_t raw_bytes = 0; // the size the records would have had as plain snapshots
+        uint64_t written_bytes = 0; // the size they have in the series
+
+        bool create(const snapshot_header& snapshot, const void* settings) {
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, SERIES_MAGIC, sizeof(header.magic));
+            header.version = SERIES_VERSION;
+            header.endian_check = SNAPSHOT_ENDIAN_CHECK;
+            header.header_size = sizeof(series_header);
+            header.width = snapshot.width;
+            header.height = snapshot.height;
+            header.agent_count = snapshot.agent_count;
+            header.agent_size = snapshot.agent_size;
+            header.keyframe_every = keyframe_every;
+            header.agents_per_chunk = SERIES_AGENTS_PER_CHUNK;
+            header.rows_per_chunk = SERIES_ROWS_PER_CHUNK;
+            header.settings_size = (uint32_t)snapshot.settings.size;
+            header.seed = snapshot.seed;
+            header.header_checksum = snapshot_checksum(&header, offsetof(series_header, header_checksum));
+
+            output = fopen(path.c_str(), "wb");
+            if (!output) {
+                fprintf(stderr, "Could not open %s to write the series.\n", path.c_str());
+                return false;
+            }
+            if (fwrite(&header, sizeof(header), 1, output) != 1 || fwrite(settings, 1, header.settings_size, output) != header.settings_size) {
+                fprintf(stderr, "Could not write the series header to %s.\n", path.c_str());
+                return false;
+            }
+            reference.resize(header.agent_count, header.width, header.height);
+            return true;
+        }
+
+    public:
+        /*
+            SeriesWriter contructor
+
+            takes in the path, the number of records between keyframes and the number of encoder threads (0 for every core)
+        */
+        SeriesWriter(const std::string& series_path, int keyframes, int thread_count) :
+            path(series_path), keyframe_every(keyframes > 0 ? keyframes : 1), threads(thread_count) {}
+
+        SeriesWriter(const SeriesWriter&) = delete;
+        SeriesWriter& operator=(const SeriesWriter&) = delete;
+
+        ~SeriesWriter() {
+            if (output)
+                fclose(output);
+            if (records > 0 && written_bytes > 0)
+                fprintf(stderr, "The series %s holds %lld records in %.1f MB, %.1fx smaller than plain snapshots.\n",
+                    path.c_str(), records, written_bytes / 1048576.0, (double)raw_bytes / written_bytes);
+        }
+
+        /*
+            append function
+
+            takes in a snapshot header (for the sizes and the step), the settings block, the agents and the RGBA float trail map
+            returns true if the record was written
+
+            description:
+                encodes every chunk in parallel, then writes the record, the chunk sizes and the chunks in order
+                a snapshot of a different size than the first one is refused, a series can't change size
+        */
+        bool append(const snapshot_header& snapshot, const void* settings, const void* agents, const void* trail) {
+            if (failed)
+                return false;
+            if (!output && !create(snapshot, settings)) {
+                failed = true;
+                return false;
+            }
+            if (snapshot.width != header.width || snapshot.height != header.height ||
+                snapshot.agent_count != header.agent_count || snapshot.agent_size != header.agent_size) {
+                fprintf(stderr, "Skipped the series record at step %llu, the simulation changed size.\n", (unsigned long long)snapshot.step);
+                return false;
+            }
+
+            const bool keyframe = records % keyframe_every == 0;
+            const int agent_chunks = (header.agent_count + SERIES_AGENTS_PER_CHUNK - 1) / SERIES_AGENTS_PER_CHUNK;
+            const int trail_chunks = (header.height + SERIES_ROWS_PER_CHUNK - 1) / SERIES_ROWS_PER_CHUNK;
+            const int chunk_count = agent_chunks + trail_chunks;
+            chunks.resize(chunk_count);
+            planes.resize(trail_chunks);
+
+            parallel_for(chunk_count, threads, [&](int chunk) {
+                if (chunk < agent_chunks) {
+                    int first = chunk * SERIES_AGENTS_PER_CHUNK;
+                    int last = first + SERIES_AGENTS_PER_CHUNK < header.agent_count ? first + SERIES_AGENTS_PER_CHUNK : header.agent_count;
+                    encode_series_agents((const uint8_t*)agents, header.agent_size, first, last, reference, keyframe, chunks[chunk]);
+                } else {
+                    int band = chunk - agent_chunks;
+                    int first = band * SERIES_ROWS_PER_CHUNK;
+                    int last = first + SERIES_ROWS_PER_CHUNK < header.height ? first + SERIES_ROWS_PER_CHUNK : header.height;
+                    encode_series_trail((const float*)trail, header.width, first, last, reference, keyframe, planes[band], chunks[chunk]);
+                }
+            });
+
+            std::vector<uint32_t> sizes(chunk_count);
+            std::vector<const uint8_t*> starts(chunk_count);
+            series_record record;
+            memset(&record, 0, sizeof(record));
+            record.flags = keyframe ? SERIES_KEYFRAME : 0;
+            record.chunk_count = chunk_count;
+            record.step = snapshot.step;
+            record.payload_size = sizes.size() * sizeof(uint32_t);
+            for (int i = 0; i < chunk_count; i++) {
+                sizes[i] = (uint32_t)chunks[i].size();
+                starts[i] = chunks[i].data();
+                record.payload_size += sizes[i];
+            }
+            record.payload_checksum = series_payload_checksum(sizes.data(), starts.data(), chunk_count);
+
+            bool written = fwrite(&record, sizeof(record), 1, output) == 1;
+            written = written && fwrite(sizes.data(), sizeof(uint32_t), sizes.size(), output) == sizes.size();
+            for (int i = 0; i < chunk_count && written; i++)
+                written = fwrite(chunks[i].data(), 1, sizes[i], output) == sizes[i];
+            written = written && fflush(output) == 0;
+            if (!written) {
+                fprintf(stderr, "Could not write to %s, the series stops here.\n", path.c_str());
+                failed = true;
+                return false;
+            }
+
+            records++;
+            raw_bytes += snapshot.settings.size + snapshot.agents.size + snapshot.trail.size;
+            written_bytes += sizeof(record) + record.payload_size;
+            return true;
+        }
+};
+
+/*
+    SeriesReader class
+
+    description:
+        reads a series file back one record at a time, decoding the chunks on a thread pool
+        the agents come back in the same layout as the agent buffer and the trail map as RGBA floats,
+        the same as the sections of a plain snapshot
+        every record but a keyframe is stored against the one before it, so records are only read in order
+
+    member variables:
+        input, header, settings
+        threads
+        reference, keyframe_read
+        payload, planes
+*/
+class SeriesReader {
+    private:
+        FILE* input = NULL;
+        int threads;
+        series_reference reference;
+        bool keyframe_read = false; // false until a keyframe was decoded, delta records before it can't be decoded
+        std::vector<uint8_t> payload;
+        std::vector<std::vector<uint16_t>> planes; // one scratch plane per trail chunk
+
+        bool fail(const char* path, const char* reason) {
+            fprintf(stderr, "Could not read the series %s: %s.\n", path, reason);
+            return false;
+        }
+
+    public:
+        series_header header;
+        std::vector<uint8_t> settings; // the settings block the series was recorded with
+
+        SeriesReader(int thread_count = 0) : threads(thread_count) {}
+        SeriesReader(const SeriesReader&) = delete;
+        SeriesReader& operator=(const SeriesReader&) = delete;
+
+        ~SeriesReader() {
+            if (input)
+                fclose(input);
+        }
+
+        /*
+            open function
+
+            takes in the path to the series
+            returns true if the header and settings were read and checked
+        */
+        bool open(const char* path) {
+            input = fopen(path, "rb");
+            if (!input)
+                return fail(path, "the file could not be opened");
+            if (fread(&header, sizeof(header), 1, input) != 1)
+                return fail(path, "the file is too small");
+            if (memcmp(header.magic, SERIES_MAGIC, sizeof(header.magic)) != 0)
+                return fail(path, "it is not a series");
+            if (header.endian_check != SNAPSHOT_ENDIAN_CHECK)
+                return fail(path, "it was saved on a machine with a different byte order");
+            if (header.version != SERIES_VERSION || header.header_size != sizeof(series_header))
+                return fail(path, "it was saved by a different version");
+            if (header.header_checksum != snapshot_checksum(&header, offsetof(series_header, header_checksum)))
+                return fail(path, "the header is corrupt");
+            if (header.agent_size < 3 * sizeof(float) || header.agents_per_chunk == 0 || header.rows_per_chunk == 0)
+                return fail(path, "the header is corrupt");
+
+            settings.resize(header.settings_size);
+            if (fread(settings.data(), 1, settings.size(), input) != settings.size())
+                return fail(path, "the file is truncated");
+            reference.resize(header.agent_count, header.width, header.height);
+            planes.resize((header.height + header.rows_per_chunk - 1) / header.rows_per_chunk);
+            return true;
+        }
+
+        /*
+            next function
+
+            takes in where to put the step, the agents (agent_count * agent_size bytes) and the trail map (width * height * 4 floats)
+            returns true if a record was decoded, false at the end of the file or on a corrupt record
+
+            description:
+                delta records before the first keyframe are skipped
+        */
+        bool next(uint64_t& step, void* agents, float* trail) {
+            while (true) {
+                series_record record;
+                if (!input || fread(&record, sizeof(record), 1, input) != 1)
+                    return false;
+
+                const int agent_chunks = (int)((header.agent_count + header.agents_per_chunk - 1) / header.agents_per_chunk);
+                const int trail_chunks = (int)((header.height + header.rows_per_chunk - 1) / header.rows_per_chunk);
+                if ((int)record.chunk_count != agent_chunks + trail_chunks || record.payload_size < record.chunk_count * sizeof(uint32_t)) {
+                    fprintf(stderr, "The series record at step %llu is corrupt.\n", (unsigned long long)record.step);
+                    return false;
+                }
+
+                payload.resize((size_t)record.payload_size);
+                if (fread(payload.data(), 1, payload.size(), input) != payload.size())
+                    return false;
+
+                const bool keyframe = (record.flags & SERIES_KEYFRAME) != 0;
+                if (!keyframe && !keyframe_read)
+                    continue;
+
+                // find every chunk and check the payload the same way it was checksummed
+                const uint32_t* sizes = (const uint32_t*)payload.data();
+                std::vector<const uint8_t*> starts(record.chunk_count);
+                const uint8_t* cursor = payload.data() + record.chunk_count * sizeof(uint32_t);
+                const uint8_t* end = payload.data() + payload.size();
+                for (uint32_t i = 0; i < record.chunk_count; i++) {
+                    if ((size_t)(end - cursor) < sizes[i]) {
+                        fprintf(stderr, "The series record at step %llu is truncated.\n", (unsigned long long)record.step);
+                        return false;
+                    }
+                    starts[i] = cursor;
+                    cursor += sizes[i];
+                }
+                if (series_payload_checksum(sizes, starts.data(), record.chunk_count) != record.payload_checksum) {
+                    fprintf(stderr, "The series record at step %llu is corrupt.\n", (unsigned long long)record.step);
+                    return false;
+                }
+
+                std::vector<char> decoded(record.chunk_count, 0);
+                parallel_for((int)record.chunk_count, threads, [&](int chunk) {
+                    const uint8_t* chunk_end = starts[chunk] + sizes[chunk];
+                    if (chunk < agent_chunks) {
+                        int first = chunk * header.agents_per_chunk;
+                        int last = first + (int)header.agents_per_chunk < header.agent_count ? first + (int)header.agents_per_chunk : header.agent_count;
+                        decoded[chunk] = decode_series_agents(starts[chunk], chunk_end, header.agent_size, first, last,
+                            reference, keyframe, (uint8_t*)agents);
+                    } else {
+                        int first = (chunk - agent_chunks) * header.rows_per_chunk;
+                        int last = first + (int)header.rows_per_chunk < header.height ? first + (int)header.rows_per_chunk : header.height;
+                        decoded[chunk] = decode_series_trail(starts[chunk], chunk_end, header.width, first, last,
+                            reference, keyframe, planes[chunk - agent_chunks], trail);
+                    }
+                });
+                for (uint32_t i = 0; i < record.chunk_count; i++) {
+                    if (!decoded[i]) {
+                        fprintf(stderr, "The series record at step %llu could not be decoded.\n", (unsigned long long)record.step);
+                        return false;
+                    }
+                }
+
+                keyframe_read = keyframe_read || keyframe;
+                step = record.step;
+                return true;
+            }
+        }
+};
@@ -130,12 +130,18 @@ struct DisplayShader {
 	void set_int(const std::string& name, int value) const {
 		glUniform1i(glGetUniformLocation(program_id, name.c_str()), value);
 	}
+	void set_uint(const std::string& name, unsigned int value) const {
+		glUniform1ui(glGetUniformLocation(program_id, name.c_str()), value);
+	}
 	void set_float(const std::string& name, float value) const {
 		glUniform1f(glGetUniformLocation(program_id, name.c_str()), value);
 	}
 	void set_vec4(const std::string& name, float value1, float value2, float value3, float value4) const {
 		glUniform4f(glGetUniformLocation(program_id, name.c_str()), value1, value2, value3, value4);
 	}
+	void set_mat4(const std::string& name, const float* value) const {
+		glUniformMatrix4fv(glGetUniformLocation(program_id, name.c_str()), 1, GL_FALSE, value);
+	}
 };
 
 /*
@@ -154,15 +160,17 @@ struct ComputeShader {
 	/*
 			ComputeShader contructor
 
+			takes in the path to the compute shader file and the #define lines to compile it with (see kernels.h)
+
 			description:
-				opens the shader file and compiles it
-				links it into a program and sets the program_id
+				opens the shader file and puts the defines in after its #version line
+				compiles it, links it into a program and sets the program_id
 	*/
-	ComputeShader() {
+	ComputeShader(const char* path, const std::string& defines = "") {
 		std::string compute_code;
-		std::ifstream compute_fin("../shaders/slime_mold.glsl");
+		std::ifstream compute_fin(path);
 		if (!compute_fin) {
-			fprintf(stderr, "Could not open compute shader.\n");
+			fprintf(stderr, "Could not open compute shader %s.\n", path);
 			exit(FILE_READ_FAIL);
 		}
 
@@ -172,6 +180,12 @@ struct ComputeShader {
 		compute_code = sout.str();
 		compute_fin.close();
 
+		// the #version line has to stay first
+		if (!defines.empty()) {
+			size_t line_end = compute_code.find('\n');
+			compute_code.insert(line_end == std::string::npos ? compute_code.size() : line_end + 1, defines);
+		}
+
 		GLuint compute_id;
 		GLint result;
 		int info_length;
@@ -236,6 +250,9 @@ struct ComputeShader {
 	void set_int(const std::string& name, int value) const {
 		glUniform1i(glGetUniformLocation(program_id, name.c_str()), value);
 	}
+	void set_uint(const std::string& name, unsigned int value) const {
+		glUniform1ui(glGetUniformLocation(program_id, name.c_str()), value);
+	}
 	void set_float(const std::string& name, float value) const {
 		glUniform1f(glGetUniformLocation(program_id, name.c_str()), value);
 	}
@@ -0,0 +1,62 @@
+#version 460 core
+
+// the size of an activity tile, this matches diffuse.glsl
+#define TILE_SIZE 16
+
+// the options the shader is compiled for, the host puts its own #defines in ahead of these, see kernels.h
+#ifndef TRAIL_FORMAT
+#define TRAIL_FORMAT rgba32f
+#endif
+
+// local group size
+layout (local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+// image textures, a sparse diffusion pass only wrote the listed tiles of diffused_map,
+// so they are copied back into trail_map and the tiles it never ran stay where they are
+layout (binding = 1, TRAIL_FORMAT) uniform writeonly image2D trail_map;
+layout (binding = 2, TRAIL_FORMAT) uniform readonly image2D diffused_map;
+
+// settings SSBO
+struct settings_struct {
+	float move_speed;
+	float turn_speed;
+	float sensor_angle;
+	float sensor_distance;
+
+	int width;
+	int height;
+
+	float r;
+	float g;
+	float b;
+	float decay_rate;
+	float diffuse_rate;
+
+	uint seed_lo;
+	uint seed_hi;
+};
+layout (std430, binding = 3) buffer settings_buffer {
+	settings_struct settings;
+};
+
+// the tile list, see tiles.glsl
+layout (std430, binding = 10) readonly buffer tile_list_buffer {
+	uint num_groups_x;
+	uint num_groups_y;
+	uint num_groups_z;
+	uint tile_list[];
+};
+
+void main() {
+	int width = settings.width;
+	int height = settings.height;
+
+	int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	uint tile_index = tile_list[gl_WorkGroupID.x];
+	ivec2 tile = ivec2(tile_index % tiles_x, tile_index / tiles_x);
+	ivec2 id = tile * TILE_SIZE + ivec2(gl_LocalInvocationID.xy);
+
+	if(id.x < width && id.y < height) {
+		imageStore(trail_map, id, imageLoad(diffused_map, id));
+	}
+}
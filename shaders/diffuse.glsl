@@ -0,0 +1,306 @@
+#version 460 core
+
+// the size of an activity tile, one work group covers one tile
+#define TILE_SIZE 16
+
+// what the pixels past the edge of the map hold
+#define BOUNDARY_CLAMP 0 // the edge pixel
+#define BOUNDARY_ZERO 1 // no trail
+#define BOUNDARY_WRAP 2 // the pixel on the other side of the map
+
+// the options the shader is compiled for, the host puts its own #defines in ahead of these, see kernels.h
+#ifndef TRAIL_FORMAT
+#define TRAIL_FORMAT rgba32f
+#endif
+#ifndef BOUNDARY_MODE
+#define BOUNDARY_MODE BOUNDARY_CLAMP
+#endif
+#ifndef WRAP_POW2
+#define WRAP_POW2 0
+#endif
+#ifndef SPECIES_COUNT
+#define SPECIES_COUNT 1
+#endif
+#ifndef DISH_COUNT
+#define DISH_COUNT 1
+#endif
+#ifndef GHOST_CELLS
+#define GHOST_CELLS 0
+#endif
+
+// local group size
+layout (local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+// image textures, the diffused map goes into a second texture so no work group reads a ghost cell another one already wrote
+layout (binding = 1, TRAIL_FORMAT) uniform readonly image2D trail_map;
+layout (binding = 2, TRAIL_FORMAT) uniform writeonly image2D diffused_map;
+// the 3x3 sum of the sense values at every pixel, kept for the sensors when blur_sensing is on
+layout (binding = 3, r32f) uniform writeonly image2D blur_map;
+
+// settings SSBO
+struct settings_struct {
+	float move_speed;
+	float turn_speed;
+	float sensor_angle;
+	float sensor_distance;
+
+	int width;
+	int height;
+
+	float r;
+	float g;
+	float b;
+	float decay_rate;
+	float diffuse_rate;
+
+	uint seed_lo;
+	uint seed_hi;
+};
+layout (std430, binding = 3) buffer settings_buffer {
+	settings_struct settings;
+};
+
+// species SSBO, only the decay and diffuse rates are read here, see slime_mold.glsl
+struct species_struct {
+	float move_speed;
+	float turn_speed;
+	float sensor_angle;
+	float sensor_distance;
+
+	vec4 deposit;
+	vec4 cap;
+	vec4 sense;
+	vec4 color;
+
+	float decay_rate;
+	uint first_agent;
+	float diffuse_rate;
+};
+layout (std430, binding = 13) readonly buffer species_buffer {
+	species_struct species[];
+};
+
+// the dish a pixel is in, the dishes fill the map row by row and each is a block of whole tiles
+int dish_of(ivec2 pixel) {
+#if DISH_COUNT > 1
+	ivec2 dish = pixel / ivec2(DISH_WIDTH, DISH_HEIGHT);
+	return dish.y * DISH_COLUMNS + dish.x;
+#else
+	return 0;
+#endif
+}
+
+// the size of a dish, without dishes the whole map is the one dish
+ivec2 dish_size() {
+#if DISH_COUNT > 1
+	return ivec2(DISH_WIDTH, DISH_HEIGHT);
+#else
+	return ivec2(settings.width, settings.height);
+#endif
+}
+
+// the pixel at the corner of the dish a pixel is in
+ivec2 dish_corner(ivec2 pixel) {
+#if DISH_COUNT > 1
+	return pixel / ivec2(DISH_WIDTH, DISH_HEIGHT) * ivec2(DISH_WIDTH, DISH_HEIGHT);
+#else
+	return ivec2(0);
+#endif
+}
+
+// what every channel decays by a step, with more than one species each channel is a species with its own rate
+// and with dishes each dish has its own rate
+vec4 species_decay(int dish) {
+#if SPECIES_COUNT > 1
+	vec4 decay = vec4(0);
+	for(int i = 0; i < SPECIES_COUNT; i++) {
+		decay[i] = species[i].decay_rate;
+	}
+	return decay;
+#elif DISH_COUNT > 1
+	return vec4(species[dish].decay_rate);
+#else
+	return vec4(settings.decay_rate);
+#endif
+}
+
+// how much of the blur a pixel takes a step, with dishes each dish has its own rate
+float dish_diffuse_rate(int dish) {
+#if DISH_COUNT > 1
+	return species[dish].diffuse_rate;
+#else
+	return settings.diffuse_rate;
+#endif
+}
+
+// tile activity SSBOs, see tiles.glsl
+layout (std430, binding = 9) buffer tile_buffer {
+	uint tile_active[];
+};
+layout (std430, binding = 10) readonly buffer tile_list_buffer {
+	uint num_groups_x;
+	uint num_groups_y;
+	uint num_groups_z;
+	uint tile_list[];
+};
+
+// with lazy decay, the last step each tile was brought up to date at
+// a tile's stored trail minus decay_rate for every step since its stamp is the trail it really holds
+layout (std430, binding = 11) readonly buffer tile_stamp_buffer {
+	int tile_stamp[];
+};
+
+// when true only the tiles in the tile list are run, one work group per tile
+uniform bool sparse;
+// when true the decay of the tiles that aren't diffused is owed to them and worked out from the stamps, see rebase.glsl
+uniform bool lazy;
+// the step being diffused
+uniform int decay_step;
+// when true the blur is also stored in blur_map
+uniform bool store_blur;
+// one of the BOUNDARY modes, a constant so the branches on it fold away
+const int boundary_mode = BOUNDARY_MODE;
+
+// wraps a pixel past the edge around to the other side of the map, glsl leaves % of a negative number undefined
+// on a power of two map the low bits are the wrapped pixel, negative ones included
+ivec2 wrap_pixel(ivec2 pixel, ivec2 map_size) {
+#if WRAP_POW2
+	return pixel & (map_size - 1);
+#else
+	return pixel - map_size * ivec2(floor(vec2(pixel) / vec2(map_size)));
+#endif
+}
+
+// false for the pixels past the edge that hold no trail
+bool boundary_inside(ivec2 pixel, ivec2 map_size) {
+	return boundary_mode != BOUNDARY_ZERO || (all(greaterThanEqual(pixel, ivec2(0))) && all(lessThan(pixel, map_size)));
+}
+
+// the pixel of the map a pixel past the edge stands for
+ivec2 boundary_pixel(ivec2 pixel, ivec2 map_size) {
+	if(boundary_mode == BOUNDARY_WRAP) {
+		return wrap_pixel(pixel, map_size);
+	}
+	return clamp(pixel, ivec2(0), map_size - 1);
+}
+
+#if GHOST_CELLS
+// the tile and a one pixel ring of ghost cells around it
+#define REGION_SIZE (TILE_SIZE + 2)
+shared vec4 region[REGION_SIZE * REGION_SIZE];
+#endif
+
+// the decay a pixel is still owed as of the given step
+float owed_decay(ivec2 pixel, int tiles_x, int at_step) {
+	if(!lazy) {
+		return 0;
+	}
+	int stamp = tile_stamp[(pixel.y / TILE_SIZE) * tiles_x + pixel.x / TILE_SIZE];
+	return settings.decay_rate * float(at_step - stamp);
+}
+
+// loads the trail as it was at the end of the last step
+vec4 load_trail(ivec2 pixel, int tiles_x) {
+	vec4 color = imageLoad(trail_map, pixel);
+	color.rgb = max(color.rgb - owed_decay(pixel, tiles_x, decay_step - 1), vec3(0));
+	return color;
+}
+
+void main() {
+	// set the width and height of the map
+	int width = settings.width;
+	int height = settings.height;
+
+	int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	ivec2 tile = ivec2(gl_WorkGroupID.xy);
+	if(sparse) {
+		uint tile_index = tile_list[gl_WorkGroupID.x];
+		tile = ivec2(tile_index % tiles_x, tile_index / tiles_x);
+	}
+	ivec2 local = ivec2(gl_LocalInvocationID.xy);
+	ivec2 id = tile * TILE_SIZE + local;
+
+	// the boundary is the edge of the tile's dish, so it is worked out in the pixels of the dish
+	ivec2 corner = dish_corner(tile * TILE_SIZE);
+	ivec2 map_size = dish_size();
+#if GHOST_CELLS
+	// load the tile and its ghost cells once, the boundary is only worked out here
+	ivec2 origin = tile * TILE_SIZE - corner - 1;
+	for(int i = int(gl_LocalInvocationIndex); i < REGION_SIZE * REGION_SIZE; i += TILE_SIZE * TILE_SIZE) {
+		ivec2 pixel = origin + ivec2(i % REGION_SIZE, i / REGION_SIZE);
+		region[i] = boundary_inside(pixel, map_size) ? load_trail(corner + boundary_pixel(pixel, map_size), tiles_x) : vec4(0);
+	}
+	barrier();
+#endif
+
+	// check if the current position is outside of the map
+	if(id.x >= width || id.y >= height) {
+		return;
+	}
+
+	// handle the decay rate and the diffuse rate
+	int dish = dish_of(id);
+	vec4 decay = species_decay(dish);
+	float diffuse_rate = dish_diffuse_rate(dish);
+
+#if GHOST_CELLS
+	// load the color originally in the image
+	vec4 original_color = region[(local.y + 1) * REGION_SIZE + local.x + 1];
+
+	// blur the image
+	vec4 blurred_color = vec4(0);
+	for(int offset_x = 0; offset_x < 3; offset_x++) {
+		for(int offset_y = 0; offset_y < 3; offset_y++) {
+			blurred_color += region[(local.y + offset_y) * REGION_SIZE + local.x + offset_x];
+		}
+	}
+#else
+	// load the color originally in the image
+	vec4 original_color = load_trail(id, tiles_x);
+
+	// blur the image, every tap is read from the image and the ones past the edge go through the boundary
+	ivec2 pixel = id - corner;
+	bool inside = all(greaterThan(pixel, ivec2(0))) && all(lessThan(pixel, map_size - 1)); // the whole 3x3 square is in the dish
+	vec4 blurred_color = vec4(0);
+	for(int offset_x = -1; offset_x <= 1; offset_x++) {
+		for(int offset_y = -1; offset_y <= 1; offset_y++) {
+			ivec2 sample_pixel = pixel + ivec2(offset_x, offset_y);
+			if(inside) {
+				blurred_color += load_trail(corner + sample_pixel, tiles_x);
+			} else if(boundary_inside(sample_pixel, map_size)) {
+				blurred_color += load_trail(corner + boundary_pixel(sample_pixel, map_size), tiles_x);
+			}
+		}
+	}
+#endif
+
+	// the sensors sum the same 3x3 square, so they can read this instead of summing it again
+	if(store_blur) {
+		imageStore(blur_map, id, vec4(dot(blurred_color, vec4(1, 1, 1, 1))));
+	}
+
+	blurred_color /= 9;
+
+	float diffuse_weight = clamp(diffuse_rate, 0, 1);
+
+	// set the trail color and store the trail map
+	vec4 trail_color = original_color * (1 - diffuse_weight) + blurred_color * diffuse_weight;
+
+	trail_color -= decay;
+#if SPECIES_COUNT == 1
+	// the map starts with alpha at 1 too, so the tiles a sparse pass never reaches sense the same as the diffused ones
+	trail_color.a = 1;
+#endif
+
+	trail_color = max(trail_color, 0.0f);
+
+	// the stamps can't move while other tiles still read them, so the tile is stored as if it were still owed
+	// the decay since its stamp, and rebase.glsl settles it once the whole pass is done
+	trail_color.rgb += owed_decay(id, tiles_x, decay_step);
+	imageStore(diffused_map, id, trail_color);
+
+	// keep the tile active while any of it still holds trail, with lazy decay only the deposits keep tiles active
+	if(!lazy && any(greaterThan(trail_color.rgb, vec3(0)))) {
+		tile_active[tile.y * tiles_x + tile.x] = 1u;
+	}
+}
@@ -0,0 +1,249 @@
+#version 460 core
+
+// the size of an activity tile, one work group covers one tile
+#define TILE_SIZE 16
+// the most diffusion steps one pass can run, the shared regions are sized for it
+#define MAX_SUBSTEPS 8
+#define REGION_SIZE (TILE_SIZE + 2 * MAX_SUBSTEPS)
+
+// what the pixels past the edge of the map hold, these match diffuse.glsl
+#define BOUNDARY_CLAMP 0
+#define BOUNDARY_ZERO 1
+#define BOUNDARY_WRAP 2
+
+// the options the shader is compiled for, the host puts its own #defines in ahead of these, see kernels.h
+#ifndef TRAIL_FORMAT
+#define TRAIL_FORMAT rgba32f
+#endif
+#ifndef BOUNDARY_MODE
+#define BOUNDARY_MODE BOUNDARY_CLAMP
+#endif
+#ifndef WRAP_POW2
+#define WRAP_POW2 0
+#endif
+#ifndef SPECIES_COUNT
+#define SPECIES_COUNT 1
+#endif
+#ifndef DISH_COUNT
+#define DISH_COUNT 1
+#endif
+
+// local group size
+layout (local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+// image textures, the diffused map goes into a second texture so no work group reads what another one wrote
+layout (binding = 1, TRAIL_FORMAT) uniform readonly image2D trail_map;
+layout (binding = 2, TRAIL_FORMAT) uniform writeonly image2D diffused_map;
+
+// settings SSBO
+struct settings_struct {
+	float move_speed;
+	float turn_speed;
+	float sensor_angle;
+	float sensor_distance;
+
+	int width;
+	int height;
+
+	float r;
+	float g;
+	float b;
+	float decay_rate;
+	float diffuse_rate;
+
+	uint seed_lo;
+	uint seed_hi;
+};
+layout (std430, binding = 3) buffer settings_buffer {
+	settings_struct settings;
+};
+
+// species SSBO, only the decay and diffuse rates are read here, see slime_mold.glsl
+struct species_struct {
+	float move_speed;
+	float turn_speed;
+	float sensor_angle;
+	float sensor_distance;
+
+	vec4 deposit;
+	vec4 cap;
+	vec4 sense;
+	vec4 color;
+
+	float decay_rate;
+	uint first_agent;
+	float diffuse_rate;
+};
+layout (std430, binding = 13) readonly buffer species_buffer {
+	species_struct species[];
+};
+
+// the dish a pixel is in, the dishes fill the map row by row and each is a block of whole tiles
+int dish_of(ivec2 pixel) {
+#if DISH_COUNT > 1
+	ivec2 dish = pixel / ivec2(DISH_WIDTH, DISH_HEIGHT);
+	return dish.y * DISH_COLUMNS + dish.x;
+#else
+	return 0;
+#endif
+}
+
+// the size of a dish, without dishes the whole map is the one dish
+ivec2 dish_size() {
+#if DISH_COUNT > 1
+	return ivec2(DISH_WIDTH, DISH_HEIGHT);
+#else
+	return ivec2(settings.width, settings.height);
+#endif
+}
+
+// the pixel at the corner of the dish a pixel is in
+ivec2 dish_corner(ivec2 pixel) {
+#if DISH_COUNT > 1
+	return pixel / ivec2(DISH_WIDTH, DISH_HEIGHT) * ivec2(DISH_WIDTH, DISH_HEIGHT);
+#else
+	return ivec2(0);
+#endif
+}
+
+// what every channel decays by a step, with more than one species each channel is a species with its own rate
+// and with dishes each dish has its own rate
+vec4 species_decay(int dish) {
+#if SPECIES_COUNT > 1
+	vec4 decay = vec4(0);
+	for(int i = 0; i < SPECIES_COUNT; i++) {
+		decay[i] = species[i].decay_rate;
+	}
+	return decay;
+#elif DISH_COUNT > 1
+	return vec4(species[dish].decay_rate);
+#else
+	return vec4(settings.decay_rate);
+#endif
+}
+
+// how much of the blur a pixel takes a step, with dishes each dish has its own rate
+float dish_diffuse_rate(int dish) {
+#if DISH_COUNT > 1
+	return species[dish].diffuse_rate;
+#else
+	return settings.diffuse_rate;
+#endif
+}
+
+// tile activity SSBO, see tiles.glsl
+layout (std430, binding = 9) buffer tile_buffer {
+	uint tile_active[];
+};
+
+// the number of diffusion steps this pass runs, 1 to MAX_SUBSTEPS
+uniform int substeps;
+// one of the BOUNDARY modes, a constant so the branches on it fold away
+const int boundary_mode = BOUNDARY_MODE;
+
+// the tile and a halo as wide as the substeps, twice so every substep reads one and writes the other
+shared vec4 region[2][REGION_SIZE * REGION_SIZE];
+
+// wraps a pixel past the edge around to the other side of the map, glsl leaves % of a negative number undefined
+// on a power of two map the low bits are the wrapped pixel, negative ones included
+ivec2 wrap_pixel(ivec2 pixel, ivec2 map_size) {
+#if WRAP_POW2
+	return pixel & (map_size - 1);
+#else
+	return pixel - map_size * ivec2(floor(vec2(pixel) / vec2(map_size)));
+#endif
+}
+
+void main() {
+	// set the width and height of the map
+	int width = settings.width;
+	int height = settings.height;
+
+	int halo = substeps;
+	int size = TILE_SIZE + 2 * halo;
+	ivec2 tile = ivec2(gl_WorkGroupID.xy);
+
+	// the boundary is the edge of the tile's dish, so everything up to the store is in the pixels of the dish
+	ivec2 corner = dish_corner(tile * TILE_SIZE);
+	ivec2 map_size = dish_size();
+	ivec2 origin = tile * TILE_SIZE - corner - halo;
+	int invocations = TILE_SIZE * TILE_SIZE;
+
+	// load the tile and its halo once, into both regions so the ghost cells that never change are in both
+	for(int i = int(gl_LocalInvocationIndex); i < size * size; i += invocations) {
+		ivec2 local = ivec2(i % size, i / size);
+		ivec2 pixel = origin + local;
+		vec4 color = vec4(0);
+		if(boundary_mode == BOUNDARY_WRAP) {
+			color = imageLoad(trail_map, corner + wrap_pixel(pixel, map_size));
+		} else if(boundary_mode == BOUNDARY_CLAMP || (all(greaterThanEqual(pixel, ivec2(0))) && all(lessThan(pixel, map_size)))) {
+			color = imageLoad(trail_map, corner + clamp(pixel, ivec2(0), map_size - 1));
+		}
+		region[0][local.y * REGION_SIZE + local.x] = color;
+		region[1][local.y * REGION_SIZE + local.x] = color;
+	}
+	barrier();
+
+	// handle the decay rate and the diffuse rate
+	int dish = dish_of(tile * TILE_SIZE);
+	vec4 decay = species_decay(dish);
+	float diffuse_weight = clamp(dish_diffuse_rate(dish), 0, 1);
+
+	// every substep is one step of diffuse.glsl, the ring of the halo that is still right shrinks by a pixel each time
+	// past the edge, wrapped ghost cells are real pixels and step like the rest, clamped ones follow the edge pixel
+	// and zero ones stay empty
+	int current = 0;
+	for(int step = 1; step <= substeps; step++) {
+		int inner = size - 2 * step;
+		for(int i = int(gl_LocalInvocationIndex); i < inner * inner; i += invocations) {
+			ivec2 local = ivec2(i % inner, i / inner) + step;
+			ivec2 pixel = origin + local;
+			bool outside = any(lessThan(pixel, ivec2(0))) || any(greaterThanEqual(pixel, map_size));
+			if(outside && boundary_mode != BOUNDARY_WRAP) {
+				continue;
+			}
+
+			vec4 original_color = region[current][local.y * REGION_SIZE + local.x];
+
+			// blur the image
+			vec4 blurred_color = vec4(0);
+			for(int offset_x = -1; offset_x <= 1; offset_x++) {
+				for(int offset_y = -1; offset_y <= 1; offset_y++) {
+					ivec2 sample_local = local + ivec2(offset_x, offset_y);
+					if(boundary_mode == BOUNDARY_CLAMP) {
+						sample_local = clamp(pixel + ivec2(offset_x, offset_y), ivec2(0), map_size - 1) - origin;
+					}
+					blurred_color += region[current][sample_local.y * REGION_SIZE + sample_local.x];
+				}
+			}
+			blurred_color /= 9;
+
+			vec4 trail_color = original_color * (1 - diffuse_weight) + blurred_color * diffuse_weight;
+
+			trail_color -= decay;
+#if SPECIES_COUNT == 1
+			trail_color.a = 1;
+#endif
+
+			region[1 - current][local.y * REGION_SIZE + local.x] = max(trail_color, 0.0f);
+		}
+		current = 1 - current;
+		barrier();
+	}
+
+	// store the tile
+	ivec2 local = ivec2(gl_LocalInvocationID.xy) + halo;
+	ivec2 id = tile * TILE_SIZE + ivec2(gl_LocalInvocationID.xy);
+	if(id.x >= width || id.y >= height) {
+		return;
+	}
+
+	vec4 trail_color = region[current][local.y * REGION_SIZE + local.x];
+	imageStore(diffused_map, id, trail_color);
+
+	// keep the tile active while any of it still holds trail
+	if(any(greaterThan(trail_color.rgb, vec3(0)))) {
+		int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tile_active[tile.y * tiles_x + tile.x] = 1u;
+	}
+}
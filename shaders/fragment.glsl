@@ -1,75 +1,66 @@
 #version 460 core
 
-out vec4 frag_color;
+// the size of an activity tile, this matches diffuse.glsl
+#define TILE_SIZE 16
 
-layout (binding = 1, rgba32f) uniform image2D trail_map;
-layout (binding = 2, rgba32f) uniform image2D agent_map;
+in vec2 map_coord;
 
-// settings SSBO
-struct settings_struct {
-	float move_speed;
-	float turn_speed;
-	float sensor_angle;
-	float sensor_distance;
+out vec4 frag_color;
 
-	int width;
-	int height;
+// the maps are sampled instead of loaded, so the window doesn't have to match the map size
+layout (binding = 0) uniform sampler2D trail_map;
+layout (binding = 1) uniform sampler2D agent_map;
 
-	float r;
-	float g;
-	float b;
-	float decay_rate;
-	float diffuse_rate;
+// with lazy decay, the last step each tile was brought up to date at, see diffuse.glsl
+layout (std430, binding = 11) readonly buffer tile_stamp_buffer {
+	int tile_stamp[];
 };
-layout (std430, binding = 3) buffer settings_buffer {
-	settings_struct settings;
-};
-
-void main() {
-	// set the width and height of the map
-	int width = settings.width;
-	int height = settings.height;
-
-	// handle the decay rate and the diffuse rate
-	float decay_rate = settings.decay_rate;
-	float diffuse_rate = settings.diffuse_rate;
-
-	// load the color originally in the image
-	vec4 original_color = imageLoad(trail_map, ivec2(gl_FragCoord.xy)).rgba;
-
-	// blur the image
-	vec4 blurred_color = vec4(0);
-	int total_weight = 0;
-	for(int offset_x = -1; offset_x <= 1; offset_x++) {
-		for(int offset_y = -1; offset_y <= 1; offset_y++) {
-			int sample_x = min(width - 1, max(0, int(gl_FragCoord.x) + offset_x));
-			int sample_y = min(width - 1, max(0, int(gl_FragCoord.y) + offset_y));
 
-			blurred_color += imageLoad(trail_map, ivec2(sample_x, sample_y)).rgba;
-			total_weight += 1;
-		}
+uniform bool lazy; // when true the trail map holds the decay still owed to each tile
+uniform float decay_rate;
+uniform int decay_step; // the last step taken
+
+// turns a texel of the trail map into its colour, the identity with one species, see species.h
+uniform mat4 species_colors;
+
+// loads one texel of the trail map with the decay it is owed taken off
+vec4 load_trail(ivec2 texel, ivec2 size) {
+	texel = clamp(texel, ivec2(0), size - 1);
+	int tiles_x = (size.x + TILE_SIZE - 1) / TILE_SIZE;
+	int stamp = tile_stamp[(texel.y / TILE_SIZE) * tiles_x + texel.x / TILE_SIZE];
+
+	vec4 color = texelFetch(trail_map, texel, 0);
+	color.rgb = max(color.rgb - decay_rate * float(decay_step - stamp), vec3(0));
+	return color;
+}
+
+// samples the trail map the same way the texture filters do, nearest when magnified and linear when shrunk,
+// but with every texel decayed by its own tile's stamp first
+vec4 sample_lazy_trail() {
+	ivec2 size = textureSize(trail_map, 0);
+	vec2 position = map_coord * vec2(size);
+
+	vec2 footprint = fwidth(position);
+	if(max(footprint.x, footprint.y) <= 1.0) {
+		return load_trail(ivec2(floor(position)), size);
 	}
 
-	blurred_color /= total_weight;
+	vec2 corner = position - 0.5;
+	ivec2 base = ivec2(floor(corner));
+	vec2 weight = fract(corner);
+	vec4 bottom = mix(load_trail(base, size), load_trail(base + ivec2(1, 0), size), weight.x);
+	vec4 top = mix(load_trail(base + ivec2(0, 1), size), load_trail(base + ivec2(1, 1), size), weight.x);
+	return mix(bottom, top, weight.y);
+}
 
-	float diffuse_weight = clamp(diffuse_rate, 0, 1);
-
-	// set the trail color and store the trail map
-	vec4 trail_color = original_color * (1 - diffuse_weight) + blurred_color * diffuse_weight;
-
-	trail_color -= decay_rate;
-	trail_color.a = 1;
-
-	imageStore(trail_map, ivec2(gl_FragCoord.xy), max(trail_color, 0.0f));
-
-	// handle the agent color and store the agent map
-	vec4 agent_color = imageLoad(agent_map, ivec2(gl_FragCoord.xy)).rgba;
-
-	if(agent_color.a > 0.1) {
-		frag_color = agent_color;
-	} else {
-		frag_color = trail_color;
-	}
-
-	imageStore(agent_map, ivec2(gl_FragCoord.xy), vec4(0, 0, 0, 0));
-}
\ No newline at end of file
+void main() {
+	// the trail map was already diffused and decayed by the diffuse compute shader
+	vec4 trail_color = lazy ? sample_lazy_trail() : texture(trail_map, map_coord).rgba;
+	trail_color = species_colors * trail_color;
+
+	// draw the agents over the trails, a shrunk map averages the agents of a block of texels
+	// so they are blended in by how much of the block they cover instead of dropping out
+	vec4 agent_color = texture(agent_map, map_coord).rgba;
+	float coverage = clamp(agent_color.a, 0.0, 1.0);
+	frag_color = mix(trail_color, vec4(agent_color.rgb / max(agent_color.a, 1e-6), 1), coverage);
+}
@@ -0,0 +1,85 @@
+#version 460 core
+
+// the size of an activity tile, this matches diffuse.glsl
+#define TILE_SIZE 16
+
+// the options the shader is compiled for, the host puts its own #defines in ahead of these, see kernels.h
+#ifndef TRAIL_FORMAT
+#define TRAIL_FORMAT rgba32f
+#endif
+
+// local group size
+layout (local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+// image textures
+layout (binding = 1, TRAIL_FORMAT) uniform image2D trail_map;
+
+// settings SSBO
+struct settings_struct {
+	float move_speed;
+	float turn_speed;
+	float sensor_angle;
+	float sensor_distance;
+
+	int width;
+	int height;
+
+	float r;
+	float g;
+	float b;
+	float decay_rate;
+	float diffuse_rate;
+
+	uint seed_lo;
+	uint seed_hi;
+};
+layout (std430, binding = 3) buffer settings_buffer {
+	settings_struct settings;
+};
+
+// the tile list, see tiles.glsl
+layout (std430, binding = 10) readonly buffer tile_list_buffer {
+	uint num_groups_x;
+	uint num_groups_y;
+	uint num_groups_z;
+	uint tile_list[];
+};
+
+// the last step each tile was brought up to date at, see diffuse.glsl
+layout (std430, binding = 11) buffer tile_stamp_buffer {
+	int tile_stamp[];
+};
+
+// when true only the tiles in the tile list are run, one work group per tile
+uniform bool sparse;
+// the step the tiles are brought up to
+uniform int decay_step;
+
+void main() {
+	int width = settings.width;
+	int height = settings.height;
+
+	int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	ivec2 tile = ivec2(gl_WorkGroupID.xy);
+	if(sparse) {
+		uint tile_index = tile_list[gl_WorkGroupID.x];
+		tile = ivec2(tile_index % tiles_x, tile_index / tiles_x);
+	}
+	int tile_index = tile.y * tiles_x + tile.x;
+	ivec2 id = tile * TILE_SIZE + ivec2(gl_LocalInvocationID.xy);
+
+	// every invocation has to read the stamp before the first one moves it on
+	int stamp = tile_stamp[tile_index];
+	barrier();
+
+	if(id.x < width && id.y < height) {
+		// take off the decay owed since the stamp, decay never takes the trail below 0 so this is the same as decaying every step
+		vec4 trail_color = imageLoad(trail_map, id);
+		trail_color.rgb = max(trail_color.rgb - settings.decay_rate * float(decay_step - stamp), vec3(0));
+		imageStore(trail_map, id, trail_color);
+	}
+
+	if(gl_LocalInvocationIndex == 0u) {
+		tile_stamp[tile_index] = decay_step;
+	}
+}
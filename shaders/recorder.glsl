@@ -0,0 +1,74 @@
+#version 460 core
+
+// the size of an activity tile, this matches diffuse.glsl
+#define TILE_SIZE 16
+
+// the options the shader is compiled for, the host puts its own #defines in ahead of these, see kernels.h
+#ifndef TRAIL_FORMAT
+#define TRAIL_FORMAT rgba32f
+#endif
+
+// local group size
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// image textures
+layout (binding = 1, TRAIL_FORMAT) uniform readonly image2D trail_map;
+
+// agents SSBO
+struct agent {
+	float x;
+	float y;
+	float angle;
+};
+layout(std430, binding = 4) readonly buffer agent_buffer {
+	agent agent_array[];
+};
+
+// the ring slot this step is recorded into
+layout(std430, binding = 5) writeonly buffer frame_buffer {
+	uint frame_pixels[]; // one RGBA8 pixel per downsampled block
+};
+layout(std430, binding = 6) writeonly buffer sample_buffer {
+	agent agent_samples[];
+};
+
+// with lazy decay, the last step each tile was brought up to date at, see diffuse.glsl
+layout(std430, binding = 11) readonly buffer tile_stamp_buffer {
+	int tile_stamp[];
+};
+
+uniform bool lazy; // when true the trail map holds the decay still owed to each tile
+uniform float decay_rate;
+uniform int decay_step; // the step being recorded
+uniform ivec2 frame_size; // the size of the downsampled frame
+uniform int factor; // the size of the block each frame pixel averages
+uniform int sample_count; // the number of agents sampled
+uniform int sample_stride; // every sample_stride agent is sampled
+
+void main() {
+	int id = int(gl_GlobalInvocationID.x);
+
+	// downsample one block of the trail map
+	if(id < frame_size.x * frame_size.y) {
+		ivec2 block = ivec2(id % frame_size.x, id / frame_size.x) * factor;
+		int tiles_x = (imageSize(trail_map).x + TILE_SIZE - 1) / TILE_SIZE;
+		vec4 sum = vec4(0);
+		for(int y = 0; y < factor; y++) {
+			for(int x = 0; x < factor; x++) {
+				ivec2 pixel = block + ivec2(x, y);
+				vec4 color = imageLoad(trail_map, pixel);
+				if(lazy) {
+					int stamp = tile_stamp[(pixel.y / TILE_SIZE) * tiles_x + pixel.x / TILE_SIZE];
+					color.rgb = max(color.rgb - decay_rate * float(decay_step - stamp), vec3(0));
+				}
+				sum += color;
+			}
+		}
+		frame_pixels[id] = packUnorm4x8(sum / float(factor * factor));
+	}
+
+	// gather the sampled agents
+	if(id < sample_count) {
+		agent_samples[id] = agent_array[id * sample_stride];
+	}
+}
@@ -0,0 +1,85 @@
+#version 460 core
+
+// the size of an activity tile, this matches diffuse.glsl
+#define TILE_SIZE 16
+// the sense values are summed as fixed point with this many steps per unit, this matches SAT_SCALE in sat.h
+#define SAT_SCALE 4096.0
+
+// the options the shader is compiled for, the host puts its own #defines in ahead of these, see kernels.h
+#ifndef TRAIL_FORMAT
+#define TRAIL_FORMAT rgba32f
+#endif
+
+// local group size, one work group scans one row or one column
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// image textures
+layout (binding = 1, TRAIL_FORMAT) uniform readonly image2D trail_map;
+
+// with lazy decay, the last step each tile was brought up to date at, see diffuse.glsl
+layout (std430, binding = 11) readonly buffer tile_stamp_buffer {
+	int tile_stamp[];
+};
+
+// the summed area table, the entry at (x, y) is the sum of the sense values from (0, 0) to (x, y)
+// the sums wrap around, but a footprint's sum is a difference of four entries so it still comes out right
+// as long as the footprint itself fits in 32 bits
+layout (std430, binding = 12) buffer sat_buffer {
+	uint sat[];
+};
+
+uniform ivec2 map_size;
+uniform int scan_pass; // 0 scans the rows of the trail map into the table, 1 scans the columns of the table in place
+uniform bool lazy; // when true the trail map holds the decay still owed to each tile
+uniform float decay_rate;
+uniform int decay_step; // the step being sensed
+
+shared uint partial[256];
+
+// the value the agents sense at a pixel in fixed point, the sum of all four channels like sense_trail
+uint sense_value(ivec2 pixel) {
+	vec4 color = imageLoad(trail_map, pixel);
+	if(lazy) {
+		int tiles_x = (map_size.x + TILE_SIZE - 1) / TILE_SIZE;
+		int stamp = tile_stamp[(pixel.y / TILE_SIZE) * tiles_x + pixel.x / TILE_SIZE];
+		color.rgb = max(color.rgb - decay_rate * float(decay_step - stamp), vec3(0));
+	}
+	return uint(dot(color, vec4(1)) * SAT_SCALE + 0.5);
+}
+
+void main() {
+	int line = int(gl_WorkGroupID.x);
+	int lane = int(gl_LocalInvocationID.x);
+	int line_length = scan_pass == 0 ? map_size.x : map_size.y;
+	if(line >= (scan_pass == 0 ? map_size.y : map_size.x)) {
+		return;
+	}
+
+	// the line is scanned 256 entries at a time, carrying the total of the chunks before
+	uint carry = 0u;
+	for(int start = 0; start < line_length; start += 256) {
+		int position = start + lane;
+		int index = scan_pass == 0 ? line * map_size.x + position : position * map_size.x + line;
+
+		uint value = 0u;
+		if(position < line_length) {
+			value = scan_pass == 0 ? sense_value(ivec2(position, line)) : sat[index];
+		}
+
+		// inclusive scan of the chunk in shared memory
+		partial[lane] = value;
+		barrier();
+		for(int offset = 1; offset < 256; offset <<= 1) {
+			uint before = lane >= offset ? partial[lane - offset] : 0u;
+			barrier();
+			partial[lane] += before;
+			barrier();
+		}
+
+		if(position < line_length) {
+			sat[index] = carry + partial[lane];
+		}
+		carry += partial[255];
+		barrier();
+	}
+}
@@ -2,13 +2,56 @@
 
 #define PI 3.1415926535
 
+// the size of an activity tile, this matches diffuse.glsl
+#define TILE_SIZE 16
+// the fixed point scale of the summed area table, this matches sat.glsl
+#define SAT_SCALE 4096.0
+
+// what the pixels past the edge of the map hold, these match diffuse.glsl
+#define BOUNDARY_CLAMP 0
+#define BOUNDARY_ZERO 1
+#define BOUNDARY_WRAP 2
+
+// the options the shader is compiled for, the host puts its own #defines in ahead of these, see kernels.h
+#ifndef TRAIL_FORMAT
+#define TRAIL_FORMAT rgba32f
+#endif
+#ifndef BOUNDARY_MODE
+#define BOUNDARY_MODE BOUNDARY_CLAMP
+#endif
+#ifndef WRAP_POW2
+#define WRAP_POW2 0
+#endif
+#ifndef SENSOR_SIZE
+#define SENSOR_SIZE 3
+#endif
+#ifndef DRAW_AGENTS
+#define DRAW_AGENTS 1
+#endif
+#ifndef SPECIES_COUNT
+#define SPECIES_COUNT 1
+#endif
+#ifndef DISH_COUNT
+#define DISH_COUNT 1
+#endif
+
+// random streams, these match rng.h
+#define RNG_STREAM_AGENT 0u
+#define RNG_STREAM_SPAWN 1u
+
 // local group size
-layout (local_size_x = 32, local_size_y = 8, local_size_z = 1) in;
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
 
 // image textures
-layout (binding = 1, rgba32f) uniform image2D trail_map;
+layout (binding = 1, TRAIL_FORMAT) uniform image2D trail_map;
 layout (binding = 2, rgba32f) uniform image2D agent_map;
 
+// the trail map with its mip pyramid, sampled by the sensors when mip_sensing is on
+layout (binding = 3) uniform sampler2D trail_pyramid;
+
+// the 3x3 sum of the sense values at every pixel, stored by diffuse.glsl when blur_sensing is on
+layout (binding = 3, r32f) uniform readonly image2D blur_map;
+
 // settings SSBO
 struct settings_struct {
 	float move_speed;
@@ -24,6 +67,9 @@ struct settings_struct {
 	float b;
 	float decay_rate;
 	float diffuse_rate;
+
+	uint seed_lo;
+	uint seed_hi;
 };
 layout (std430, binding = 3) buffer settings_buffer {
 	settings_struct settings;
@@ -39,34 +85,233 @@ layout(std430, binding = 4) buffer agent_buffer {
 	agent agent_array[];
 };
 
-uint hash(uint state) {
-	state ^= 2747636419u;
-	state *= 2654435769u;
-	state ^= state >> 16;
-	state *= 2654435769u;
-	state ^= state >> 16;
-	state *= 2654435769u;
-	return state;
+// species SSBO, the parameters of every species, see species.h
+struct species_struct {
+	float move_speed;
+	float turn_speed;
+	float sensor_angle;
+	float sensor_distance;
+
+	vec4 deposit; // added to the trail under an agent every step
+	vec4 cap; // the most trail a deposit can take a texel up to
+	vec4 sense; // the weight of each channel when sensing
+	vec4 color;
+
+	float decay_rate;
+	uint first_agent;
+	float diffuse_rate; // with dishes, the diffuse rate of the dish
+};
+layout (std430, binding = 13) readonly buffer species_buffer {
+	species_struct species[];
+};
+
+// tile activity SSBO, see tiles.glsl
+layout (std430, binding = 9) buffer tile_buffer {
+	uint tile_active[];
+};
+
+// with lazy decay, the last step each tile was brought up to date at, see diffuse.glsl
+layout (std430, binding = 11) readonly buffer tile_stamp_buffer {
+	int tile_stamp[];
+};
+
+// the summed area table of the sense values, built by sat.glsl before this shader runs
+layout (std430, binding = 12) readonly buffer sat_buffer {
+	uint sat[];
+};
+
+// the current step, used as part of the random counter
+uniform uint step_index;
+// the width of the square each sensor sums, an odd number
+const int sensor_size = SENSOR_SIZE;
+// when true the sensors read the summed area table, 4 reads a sensor whatever the sensor size
+uniform bool sat_sensing;
+// when true each sensor is one filtered fetch from the level of the trail pyramid that matches its footprint
+uniform bool mip_sensing;
+// when true each sensor is one read of the sum the diffusion pass already made
+uniform bool blur_sensing;
+// one of the BOUNDARY modes
+const int boundary_mode = BOUNDARY_MODE;
+
+// when true the trail map holds the decay still owed to each tile, see diffuse.glsl
+uniform bool lazy;
+
+// Philox4x32-10 counter based generator, the same function as philox4x32 in rng.h
+uvec4 philox(uvec4 counter, uvec2 key) {
+	for(int i = 0; i < 10; i++) {
+		uint hi0, lo0, hi1, lo1;
+		umulExtended(0xD2511F53u, counter.x, hi0, lo0);
+		umulExtended(0xCD9E8D57u, counter.z, hi1, lo1);
+
+		counter = uvec4(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+		key += uvec2(0x9E3779B9u, 0xBB67AE85u);
+	}
+	return counter;
 }
 
+// turns a random word into a float in [0, 1), the same as rng_unit in rng.h
 float normalize(uint state) {
-	float res = state / 4294967295.f;
-	return res;
+	return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+// the decay a pixel is still owed after this step's diffusion
+float owed_decay(ivec2 pixel) {
+	if(!lazy) {
+		return 0;
+	}
+	int tiles_x = (settings.width + TILE_SIZE - 1) / TILE_SIZE;
+	int stamp = tile_stamp[(pixel.y / TILE_SIZE) * tiles_x + pixel.x / TILE_SIZE];
+	return settings.decay_rate * float(int(step_index) - stamp);
+}
+
+// loads the trail as it is after this step's diffusion
+vec4 load_trail(ivec2 pixel) {
+	vec4 color = imageLoad(trail_map, pixel);
+	color.rgb = max(color.rgb - owed_decay(pixel), vec3(0));
+	return color;
+}
+
+// the sum of the sense values in the rectangle from low to high, both corners included
+float sat_sum(ivec2 low, ivec2 high) {
+	int width = settings.width;
+	uint sum = sat[high.y * width + high.x];
+	if(low.x > 0) {
+		sum -= sat[high.y * width + low.x - 1];
+	}
+	if(low.y > 0) {
+		sum -= sat[(low.y - 1) * width + high.x];
+	}
+	if(low.x > 0 && low.y > 0) {
+		sum += sat[(low.y - 1) * width + low.x - 1];
+	}
+	return float(sum) / SAT_SCALE;
+}
+
+// wraps a pixel past the edge around to the other side of the map, glsl leaves % of a negative number undefined
+// on a power of two map the low bits are the wrapped pixel, negative ones included
+ivec2 wrap_pixel(ivec2 pixel, ivec2 map_size) {
+#if WRAP_POW2
+	return pixel & (map_size - 1);
+#else
+	return pixel - map_size * ivec2(floor(vec2(pixel) / vec2(map_size)));
+#endif
 }
 
-float sense_trail(agent a, float sensor_offset, float sensor_distance) {
+// wraps a position past the edge around to the other side of the map with no branches
+// on a power of two map the whole pixel is wrapped with the mask and the fraction is kept, so there is no divide either
+vec2 wrap_position(vec2 position, ivec2 map_size) {
+	vec2 size = vec2(map_size);
+#if WRAP_POW2
+	vec2 whole = floor(position);
+	vec2 wrapped = vec2(ivec2(whole) & (map_size - 1)) + (position - whole);
+#else
+	vec2 wrapped = position - size * floor(position / size);
+#endif
+	// a position just below 0 can round up to the far edge itself, which isn't a pixel
+	return wrapped - size * step(size, wrapped);
+}
+
+// the species of an agent, the agents of each species are one block of ids
+// with dishes every dish is an entry of the species table, and every dish has the same number of agents
+int species_of(uint agent_id) {
+#if DISH_COUNT > 1
+	return int(agent_id / uint(DISH_AGENTS));
+#endif
+	int kind = 0;
+	for(int i = 1; i < SPECIES_COUNT; i++) {
+		kind += int(agent_id >= species[i].first_agent);
+	}
+	return kind;
+}
+
+// the size of the dish the agents move in, without dishes the whole map is the one dish
+ivec2 dish_size() {
+#if DISH_COUNT > 1
+	return ivec2(DISH_WIDTH, DISH_HEIGHT);
+#else
+	return ivec2(settings.width, settings.height);
+#endif
+}
+
+// the pixel at the corner of a dish, the dishes fill the map row by row
+ivec2 dish_corner(int dish) {
+#if DISH_COUNT > 1
+	return ivec2(dish % DISH_COLUMNS, dish / DISH_COLUMNS) * ivec2(DISH_WIDTH, DISH_HEIGHT);
+#else
+	return ivec2(0);
+#endif
+}
+
+// the sensing works in the pixels of the agent's dish, corner is where the dish is in the map
+// sense_lod is the pyramid level mip sensing reads, log2 of the footprint width
+float sense_trail(agent a, float sensor_offset, float sensor_distance, float sense_lod, vec4 sense_weights, ivec2 corner, ivec2 map_size) {
 	float sensor_angle = a.angle + sensor_offset;
 
+	// the average over the footprint is scaled back up to a sum, so the sense values stay on the same scale as the other modes
+	if(mip_sensing) {
+		vec2 sensor = vec2(a.x + cos(sensor_angle) * sensor_distance, a.y + sin(sensor_angle) * sensor_distance);
+		vec2 coord = (floor(sensor) + 0.5) / vec2(settings.width, settings.height);
+		float footprint = exp2(sense_lod);
+		return dot(textureLod(trail_pyramid, coord, sense_lod), sense_weights) * footprint * footprint;
+	}
+
 	int sensor_x = int(a.x + cos(sensor_angle) * sensor_distance);
 	int sensor_y = int(a.y + sin(sensor_angle) * sensor_distance);
+	int radius = sensor_size / 2;
+	ivec2 sensor = ivec2(sensor_x, sensor_y) - corner;
+
+	// the sum is of the map before this step's diffusion, a step behind the other modes
+	if(blur_sensing) {
+		if(boundary_mode == BOUNDARY_WRAP) {
+			sensor = wrap_pixel(sensor, map_size);
+		} else if(any(lessThan(sensor, ivec2(0))) || any(greaterThanEqual(sensor, map_size))) {
+			if(boundary_mode == BOUNDARY_ZERO) {
+				return 0;
+			}
+			sensor = clamp(sensor, ivec2(0), map_size - 1);
+		}
+		return imageLoad(blur_map, corner + sensor).r;
+	}
 
+	// the footprint is cut off at the edges of the map, whatever the boundary mode
+	if(sat_sensing) {
+		ivec2 low = clamp(sensor - radius, ivec2(0), map_size - 1);
+		ivec2 high = clamp(sensor + radius, ivec2(0), map_size - 1);
+		return sat_sum(corner + low, corner + high);
+	}
+
+	// on a power of two torus wrapping every tap costs less than checking whether the footprint is inside
 	float sense_sum = 0;
-	for(int offset_x = -1; offset_x <= 1; offset_x++) {
-		for(int offset_y = -1; offset_y <= 1; offset_y++) {
-			int sample_x = min(settings.width - 1, max(0, sensor_x + offset_x));
-			int sample_y = min(settings.height - 1, max(0, sensor_y + offset_y));
+	if(boundary_mode == BOUNDARY_WRAP && WRAP_POW2 == 1) {
+		for(int offset_x = -radius; offset_x <= radius; offset_x++) {
+			for(int offset_y = -radius; offset_y <= radius; offset_y++) {
+				sense_sum += dot(load_trail(corner + wrap_pixel(sensor + ivec2(offset_x, offset_y), map_size)), sense_weights);
+			}
+		}
+		return sense_sum;
+	}
 
-			sense_sum += dot(imageLoad(trail_map, ivec2(sample_x, sample_y)), vec4(1, 1, 1, 1));
+	// most footprints are inside the map, and those need no boundary handling at all
+	if(all(greaterThanEqual(sensor - radius, ivec2(0))) && all(lessThan(sensor + radius, map_size))) {
+		for(int offset_x = -radius; offset_x <= radius; offset_x++) {
+			for(int offset_y = -radius; offset_y <= radius; offset_y++) {
+				sense_sum += dot(load_trail(corner + sensor + ivec2(offset_x, offset_y)), sense_weights);
+			}
+		}
+		return sense_sum;
+	}
+
+	for(int offset_x = -radius; offset_x <= radius; offset_x++) {
+		for(int offset_y = -radius; offset_y <= radius; offset_y++) {
+			ivec2 sample_pixel = sensor + ivec2(offset_x, offset_y);
+			if(boundary_mode == BOUNDARY_WRAP) {
+				sample_pixel = wrap_pixel(sample_pixel, map_size);
+			} else if(boundary_mode == BOUNDARY_ZERO && (any(lessThan(sample_pixel, ivec2(0))) || any(greaterThanEqual(sample_pixel, map_size)))) {
+				continue;
+			}
+			sample_pixel = clamp(sample_pixel, ivec2(0), map_size - 1);
+
+			sense_sum += dot(load_trail(corner + sample_pixel), sense_weights);
 		}
 	}
 
@@ -74,37 +319,46 @@ float sense_trail(agent a, float sensor_offset, float sensor_distance) {
 }
 
 void main() {
-	// set the width and height of the map
-	int width = settings.width;
-	int height = settings.height;
-
-	// set the move and turn speed that will be associated with the sim
-	float move_speed = settings.move_speed;
-	float turn_speed = settings.turn_speed;
-
-	// set the agent sensor angle and sensor distance
-	float sensor_angle = settings.sensor_angle;
-	float sensor_distance = settings.sensor_distance;
-
 	ivec2 id = ivec2(gl_GlobalInvocationID.xy);
 
 	// check if the current position in the computer is larger than the array given to the computer
-	if(id.x > agent_array.length()) {
+	if(id.x >= agent_array.length()) {
 		return;
 	}
 
+	// every species moves, senses and deposits its own way
+	int kind_index = species_of(uint(id.x));
+	species_struct kind = species[kind_index];
+
+	// with dishes an agent moves and senses inside its own dish, without them the dish is the map
+	ivec2 corner = dish_corner(kind_index);
+	ivec2 dish = dish_size();
+	int width = dish.x;
+	int height = dish.y;
+
+	// set the move and turn speed that will be associated with the sim
+	float move_speed = kind.move_speed;
+	float turn_speed = kind.turn_speed;
+
+	// set the agent sensor angle and sensor distance
+	float sensor_angle = kind.sensor_angle;
+	float sensor_distance = kind.sensor_distance;
+
 	// set the current agent we will work with
 	agent current_agent = agent_array[id.x];
 
-	// initialize a random value
-	uint rand = hash(int(current_agent.y * width + current_agent.x) + hash(int(id.x * 824941)));
+	// draw this agent's random words for this step
+	uvec4 rand = philox(uvec4(id.x, step_index, RNG_STREAM_AGENT, 0), uvec2(settings.seed_lo, settings.seed_hi));
+
+	// with mip sensing the footprint grows with the species' sensor distance, so neighbouring sensors don't read the same pixels
+	float sense_lod = log2(max(float(sensor_size), sensor_distance * sensor_angle));
 
 	// se the sense values for the agent
-	float sense_f = sense_trail(current_agent, 0, sensor_distance);
-	float sense_l = sense_trail(current_agent, sensor_angle, sensor_distance);
-	float sense_r = sense_trail(current_agent, -sensor_angle, sensor_distance);
+	float sense_f = sense_trail(current_agent, 0, sensor_distance, sense_lod, kind.sense, corner, dish);
+	float sense_l = sense_trail(current_agent, sensor_angle, sensor_distance, sense_lod, kind.sense, corner, dish);
+	float sense_r = sense_trail(current_agent, -sensor_angle, sensor_distance, sense_lod, kind.sense, corner, dish);
 
-	float steer_strength = normalize(hash(rand));
+	float steer_strength = normalize(rand.x);
 
 	if (sense_f == 0 && sense_l == 0 && sense_r == 0) { // if there is no trail to sense, just go crazy
 		current_agent.angle += (steer_strength - 0.5) * 2 * turn_speed;
@@ -120,33 +374,44 @@ void main() {
 		current_agent.angle += (steer_strength - 0.5) * 2 * turn_speed;
 	}
 
-	// move the agent in its new angle
-	current_agent.x += move_speed * cos(current_agent.angle);
-	current_agent.y += move_speed * sin(current_agent.angle);
+	// move the agent in its new angle, in the pixels of its dish
+	current_agent.x += move_speed * cos(current_agent.angle) - corner.x;
+	current_agent.y += move_speed * sin(current_agent.angle) - corner.y;
 
-	// check if it hits the wall, then bounce it off the wall in a random direction
-	if (current_agent.x <= 0 || current_agent.x >= width || current_agent.y <= 0 || current_agent.y >= height) {
-		rand = hash(rand);
-		float rand_angle = normalize(rand) * 2 * PI;
+	if(boundary_mode == BOUNDARY_WRAP) {
+		// the map is a torus, an agent going off one edge comes back on the other keeping its heading
+		vec2 position = wrap_position(vec2(current_agent.x, current_agent.y), ivec2(width, height));
+		current_agent.x = position.x;
+		current_agent.y = position.y;
+	} else if (current_agent.x <= 0 || current_agent.x >= width || current_agent.y <= 0 || current_agent.y >= height) {
+		// check if it hits the wall, then bounce it off the wall in a random direction
+		float rand_angle = normalize(rand.y) * 2 * PI;
 
 		current_agent.x = min(width - 1, max(0, current_agent.x));
 		current_agent.y = min(height - 1, max(0, current_agent.y));
 		current_agent.angle = rand_angle;
 	}
+	current_agent.x += corner.x;
+	current_agent.y += corner.y;
 
 	// store the agent map
 	agent_array[id.x] = current_agent;
 
-	vec4 agent_color = vec4(settings.r, settings.g, settings.b, 1);
-
-	imageStore(agent_map, ivec2(current_agent.x, current_agent.y), agent_color);
+#if DRAW_AGENTS
+	imageStore(agent_map, ivec2(current_agent.x, current_agent.y), kind.color);
+#endif
 
-	// store the trail map
-	vec4 deposit = vec4(agent_color / 5);
-	deposit.a = 1;
+	// store the trail map, with one species the deposit is a fifth of its colour up to its colour
+	// and with more it only raises the species' own channel
+	ivec2 trail_pixel = ivec2(current_agent.x, current_agent.y);
+	vec4 previous_trail = load_trail(trail_pixel);
+	vec4 new_trail = min(previous_trail + kind.deposit, kind.cap);
 
-	vec4 previous_trail = imageLoad(trail_map, ivec2(current_agent.x, current_agent.y));
-	vec4 new_trail = vec4(min(previous_trail + deposit, agent_color));
+	// a tile that wasn't diffused this step is still owed its decay, so the deposit is stored owing it too
+	new_trail.rgb += owed_decay(trail_pixel);
+	imageStore(trail_map, trail_pixel, new_trail);
 
-	imageStore(trail_map, ivec2(current_agent.x, current_agent.y), new_trail);
+	// the tile the trail landed in has to be diffused next step
+	int tiles_x = (settings.width + TILE_SIZE - 1) / TILE_SIZE;
+	tile_active[(int(current_agent.y) / TILE_SIZE) * tiles_x + int(current_agent.x) / TILE_SIZE] = step_index + 1u;
 }
@@ -0,0 +1,57 @@
+#version 460 core
+
+// local group size
+layout (local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+
+// one flag per TILE_SIZE x TILE_SIZE tile of the trail map, set by diffuse.glsl and slime_mold.glsl
+// wherever trail was left during the last step
+// with lazy decay the flags aren't cleared and hold the last step an agent deposited in the tile, plus 1
+layout (std430, binding = 9) readonly buffer tile_buffer {
+	uint tile_active[];
+};
+
+// the indirect dispatch arguments for diffuse.glsl followed by the tiles it should run
+// num_groups_x is cleared to 0 before this shader runs, num_groups_y and num_groups_z stay 1
+layout (std430, binding = 10) buffer tile_list_buffer {
+	uint num_groups_x;
+	uint num_groups_y;
+	uint num_groups_z;
+	uint tile_list[];
+};
+
+uniform ivec2 tile_count; // the number of tiles across and down
+uniform uint current_step; // the step being diffused
+uniform uint idle_steps; // with lazy decay, the steps a tile is still diffused after its last deposit, 0 without lazy decay
+uniform bool wrap; // true when the map wraps around, so the tiles on opposite edges are next to each other
+uniform ivec2 dish_tiles; // the tiles across and down a dish, with dishes each one wraps on its own edges
+
+bool tile_active_now(uint flag) {
+	return flag != 0u && (idle_steps == 0u || flag + idle_steps > current_step);
+}
+
+void main() {
+	int id = int(gl_GlobalInvocationID.x);
+	if(id >= tile_count.x * tile_count.y) {
+		return;
+	}
+
+	// a tile is diffused if it or any tile next to it holds trail, the blur spreads trail one pixel a step
+	ivec2 tile = ivec2(id % tile_count.x, id / tile_count.x);
+	bool near_trail = false;
+	for(int offset_y = -1; offset_y <= 1; offset_y++) {
+		for(int offset_x = -1; offset_x <= 1; offset_x++) {
+			ivec2 neighbor = tile + ivec2(offset_x, offset_y);
+			if(wrap) {
+				ivec2 dish_corner = tile / dish_tiles * dish_tiles;
+				neighbor = dish_corner + (neighbor - dish_corner + dish_tiles) % dish_tiles;
+			}
+			if(all(greaterThanEqual(neighbor, ivec2(0))) && all(lessThan(neighbor, tile_count))) {
+				near_trail = near_trail || tile_active_now(tile_active[neighbor.y * tile_count.x + neighbor.x]);
+			}
+		}
+	}
+
+	if(near_trail) {
+		tile_list[atomicAdd(num_groups_x, 1u)] = uint(id);
+	}
+}
@@ -0,0 +1,46 @@
+#version 460 core
+
+// local group size
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// agents SSBO
+struct agent {
+	float x;
+	float y;
+	float angle;
+};
+layout(std430, binding = 4) readonly buffer agent_buffer {
+	agent agent_array[];
+};
+
+// the ids of the agents being followed
+layout(std430, binding = 7) readonly buffer probe_buffer {
+	uint probe_ids[];
+};
+
+// one batch of records, a row of probe_count records per step
+struct trajectory_record {
+	uint step;
+	uint id;
+	float x;
+	float y;
+	float heading;
+};
+layout(std430, binding = 8) writeonly buffer batch_buffer {
+	trajectory_record records[];
+};
+
+uniform uint probe_count; // the number of agents being followed
+uniform uint row; // the row of the batch this step goes in
+uniform uint step_index; // the step being recorded
+
+void main() {
+	uint id = gl_GlobalInvocationID.x;
+	if(id >= probe_count) {
+		return;
+	}
+
+	uint agent_id = probe_ids[id];
+	agent current_agent = agent_array[agent_id];
+	records[row * probe_count + id] = trajectory_record(step_index, agent_id, current_agent.x, current_agent.y, current_agent.angle);
+}
@@ -4,6 +4,9 @@ layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 color;
 layout (location = 2) in vec2 texture_coord;
 
+out vec2 map_coord;
+
 void main() {
 	gl_Position = vec4(pos.x, pos.y, pos.z, 1.0);
+	map_coord = texture_coord;
 }
\ No newline at end of file
@@ -6,10 +6,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fstream>
 #include <string>
+#include <vector>
 #include <random>
 #include <cmath>
+#include <stdint.h>
 
 #define GLEW_STATIC
 #include <glew.h>
@@ -19,19 +22,61 @@
 using json = nlohmann::json;
 
 #include "shader.h"
+#include "rng.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "series.h"
+#include "capture.h"
+#include "video_sink.h"
+#include "image_writer.h"
+#include "flight_recorder.h"
+#include "trajectory.h"
+#include "kernels.h"
+#include "spawn.h"
+#include "species.h"
+#include "dishes.h"
 
 // program settings
 struct program_settings {
     bool fullscreen = false; // boolean to keep track of if the window is fullscreen
     bool paused = true; // boolean to keep track of if the simulation is paused
+    int swap_interval = 1; // the number of screen refreshes to wait before swapping, 0 turns vsync off
+    bool save_requested = false; // set by the key callback, the run loop saves a snapshot when it sees it
+    bool dump_requested = false; // set by the key callback, the run loop dumps the flight recorder when it sees it
 
-    // width and height of the window / map of the simulation
+    // width and height of the window, the map keeps its own size in the simulation settings
     int width = 0;
     int height = 0;
+    int x = 500; // position of the window, remembered when going fullscreen
+    int y = 500;
+
+    // width and height of the map, used to keep its aspect ratio in the window
+    int map_width = 0;
+    int map_height = 0;
+    bool map_shrunk = false; // true when the map is drawn smaller than it is, so it has to be filtered down
 } window_settings; // declaring a struct as well
 
+/*
+    frame_callback function
+
+    takes in a GLFWwindow pointer and the new framebuffer size
+
+    description:
+        fits the map into the framebuffer without stretching it, the rest of the framebuffer is left black
+*/
 void frame_callback(GLFWwindow* window, int width, int height) {
-    glViewport(0, 0, width, height);
+    if (window_settings.map_width <= 0 || window_settings.map_height <= 0 || width <= 0 || height <= 0) {
+        glViewport(0, 0, width, height);
+        window_settings.map_shrunk = false;
+        return;
+    }
+
+    float scale = std::min((float)width / window_settings.map_width, (float)height / window_settings.map_height);
+    window_settings.map_shrunk = scale < 1;
+    int viewport_width = (int)(window_settings.map_width * scale);
+    int viewport_height = (int)(window_settings.map_height * scale);
+    glViewport((width - viewport_width) / 2, (height - viewport_height) / 2, viewport_width, viewport_height);
 }
 /*
     get_current_monitor function
@@ -96,13 +141,20 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     // handling the f11 key, which full screens the program
     if (key == GLFW_KEY_F11 && action == GLFW_PRESS) {
         if (!window_settings.fullscreen) {
+            GLFWmonitor* monitor = get_current_monitor(window);
+            if (monitor == NULL)
+                monitor = glfwGetPrimaryMonitor();
+            const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+
             window_settings.fullscreen = true;
-            glfwSetWindowMonitor(window, get_current_monitor(window), 0, 0, window_settings.width, window_settings.height, GLFW_DONT_CARE);
+            glfwGetWindowPos(window, &window_settings.x, &window_settings.y);
+            glfwGetWindowSize(window, &window_settings.width, &window_settings.height);
+            glfwSetWindowMonitor(window, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
             glfwSwapBuffers(window);
         }
         else {
             window_settings.fullscreen = false;
-            glfwSetWindowMonitor(window, NULL, 500, 500, window_settings.width, window_settings.height, GLFW_DONT_CARE);
+            glfwSetWindowMonitor(window, NULL, window_settings.x, window_settings.y, window_settings.width, window_settings.height, GLFW_DONT_CARE);
             glfwSwapBuffers(window);
         }
     }
@@ -110,6 +162,14 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     // handling the space key, which pauses the simulation
     if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
         window_settings.paused = !(window_settings.paused);
+
+    // handling the f5 key, which saves a snapshot of the simulation
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+        window_settings.save_requested = true;
+
+    // handling the f9 key, which dumps the last recorded steps
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+        window_settings.dump_requested = true;
 }
 
 /*
@@ -129,8 +189,11 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         spawn_method
         agent_array
         agentSSBO
+        seed, step_count
         display
         compute
+        diffuse
+        scheduler
 */
 class Simulation {
     private:
@@ -152,6 +215,10 @@ class Simulation {
             float b;
             float decay_rate;
             float diffuse_rate;
+
+            // random number generator key
+            unsigned int seed_lo;
+            unsigned int seed_hi;
         } sim_settings; // a simulation_settings struct to house all the information from the json file
         GLuint settingsSSBO; // used to hold the shader storage buffer object            
         GLFWwindow* simulation_window = NULL; // pointer to the GLFWwindow
@@ -170,9 +237,106 @@ class Simulation {
         } *agent_array; // holds all the agent struct pointers
         GLuint agentSSBO; // agent shader storage buffer object
 
+        // random number settings
+        uint64_t seed; // the seed that keys every random stream in the simulation
+        unsigned int step_count = 0; // the number of steps taken, used as part of the random counter
+
         // shaders
         DisplayShader* display; // the vertex and fragment shaders
-        ComputeShader* compute; // the compute shader
+        ComputeShader* compute = NULL; // the agent compute shader
+        ComputeShader* diffuse = NULL; // the trail diffusion and decay compute shader
+
+        // sparse diffusion, only the tiles of the trail map that hold trail (or are next to one that does) are diffused
+        static const int tile_size = 16; // TILE_SIZE in the shaders
+        bool sparse_diffusion; // false diffuses every tile every step
+        int tiles_x = 0; // the number of tiles across and down the map
+        int tiles_y = 0;
+        GLuint tileSSBO = 0; // one activity flag per tile
+        GLuint tileListSSBO = 0; // the indirect dispatch arguments followed by the tiles to diffuse
+        ComputeShader* tiles = NULL; // turns the activity flags into the tile list
+        GLuint diffuse_query = 0; // when set, the diffusion of each step is timed into this query
+        GLuint agent_query = 0; // when set, the agent pass of each step is timed into this query
+        GLuint recorder_query = 0; // when set, the flight recorder pass of each recorded step is timed into this query
+
+        // lazy decay, tiles no agent has deposited in for a while aren't diffused and only owe their decay
+        // the decay is taken off in closed form from the step each tile was last brought up to date at
+        bool lazy_decay; // false decays every tile every step
+        int lazy_idle_steps; // the steps a tile keeps being diffused after its last deposit
+        GLuint tileStampSSBO = 0; // the step each tile was last brought up to date at
+        ComputeShader* rebase = NULL; // takes the owed decay off tiles and moves their stamps on
+        ComputeShader* copy_tiles = NULL; // copies the tiles a sparse diffusion pass ran from trail_scratch back to trail_texture
+
+        // temporal blocking, several diffusion steps are run for every agent step in one pass over the map
+        static const int max_substeps = 8; // MAX_SUBSTEPS in diffuse_blocked.glsl
+        int diffusion_substeps; // the diffusion steps run for every agent step, 1 runs diffuse.glsl
+        GLuint trail_scratch; // the diffusion passes write the diffused map here, then it is swapped with trail_texture
+        ComputeShader* diffuse_blocked = NULL; // runs up to max_substeps diffusion steps on a tile held in shared memory
+
+        // the options compiled into the shaders, see kernels.h
+        // each sensor sums a sensor_size x sensor_size square of the trail map, 3 is the original footprint
+        kernel_options kernels;
+        GLenum trail_format; // the internal format of the trail map, matches kernels.trail_precision
+
+        std::vector<species_settings> species; // one entry per species, see species.h
+        GLuint speciesSSBO = 0; // the species table the shaders read
+        bool sat_sensing; // true builds a summed area table every step so a sensor costs 4 reads whatever its size
+        GLuint satSSBO = 0; // the summed area table, see sat.glsl
+        ComputeShader* sat_scan = NULL; // builds the summed area table
+        bool mip_sensing; // true builds a mip pyramid of the trail map every step and each sensor reads the level matching its footprint
+        GLuint pyramid_sampler = 0; // the trilinear sampler the sensors read the pyramid through
+        bool blur_sensing; // true has the diffusion pass keep its 3x3 sums so each sensor is one read
+        GLuint blur_texture = 0; // the 3x3 sums, one float a pixel
+
+        FrameScheduler scheduler; // decides how many steps run for every presented frame
+        int steps_per_frame; // the number of steps run before each frame is presented
+        double steps_per_second; // the target step rate, 0 ties the step rate to the frame rate
+        double max_fps; // the most frames presented per second, 0 doesn't cap it
+        double cpu_budget; // the percent of one core the process should stay under, only used for reporting
+
+        std::string checkpoint_path; // where the f5 key and the periodic checkpoints save a snapshot
+        int checkpoint_every; // the number of steps between periodic checkpoints, 0 turns them off
+        unsigned int next_checkpoint = 0; // the step the next periodic checkpoint is taken at
+        Checkpointer* checkpointer; // takes the checkpoints in the background
+
+        // compressed time series settings
+        std::string series_path; // where the series is recorded
+        int series_every; // the number of steps between series records, 0 turns the series off
+        int series_keyframe_every; // the number of records between keyframes
+        int series_threads; // the number of encoder threads, 0 uses every core
+        unsigned int next_series = 0; // the step the next series record is taken at
+        SeriesWriter* series_writer = NULL; // encodes and appends the records
+        Checkpointer* series_recorder = NULL; // copies the records out in the background and hands them to the writer
+
+        // flight recorder settings
+        int recorder_frames; // the number of recorded steps kept, 0 turns the recorder off
+        int recorder_every; // record every nth step
+        int recorder_downsample; // the size of the trail map blocks averaged into one recorded pixel
+        int recorder_agent_stride; // record every nth agent
+        std::string recorder_prefix; // the start of every dump file name
+        FlightRecorder* recorder = NULL; // keeps the last recorder_frames recorded steps
+
+        // trajectory probe settings
+        std::string trajectory_path; // where the trajectories are streamed
+        int trajectory_stride; // follow every nth agent, 0 for none
+        std::vector<uint32_t> trajectory_ids; // more agents to follow by id
+        int trajectory_batch; // the steps gathered on the gpu before they are read back
+        TrajectoryProbe* trajectory = NULL; // follows the agents, only made when there are agents to follow
+
+        // frame capture settings
+        int capture_source; // CAPTURE_TRAIL or CAPTURE_FRAME
+        int capture_every; // capture every nth presented frame
+        int capture_buffers; // the number of pixel buffers in rotation
+        long long presented_frames = 0; // the number of frames presented so far
+        FrameCapture* capture = NULL; // reads frames back without stalling, only made once a sink is set
+        FrameSink* frame_sink = NULL; // where the captured frames go
+        std::string capture_sink; // the kind of sink the settings ask for, empty for none
+        std::string capture_path; // where that sink writes
+        int capture_queue; // the number of frames a sink may queue before it drops frames, the image writer queues at least one per thread
+        int capture_drop; // DROP_OLDEST or DROP_NEWEST
+        int video_fps; // the frame rate written into the video
+        std::string image_prefix; // the start of every image dump file name
+        int image_threads; // the number of image writer threads, 0 picks from the core count
+        float tone_curve; // the tone curve used when dumping float frames to png
 
         /*
             init_settings function
@@ -191,10 +355,14 @@ class Simulation {
             fin >> settings_file;
 
             AGENT_COUNT = settings_file["agent_count"];
+            kernels.species_count = read_species(settings_file, species, AGENT_COUNT);
             spawn_method = settings_file["spawn_method"];
 
-            window_settings.width = settings_file["map_width"];
-            window_settings.height = settings_file["map_height"];
+            // the window defaults to the map size, it gets shrunk to fit the monitor once GLFW is up
+            window_settings.width = settings_file.value("window_width", settings_file["map_width"].get<int>());
+            window_settings.height = settings_file.value("window_height", settings_file["map_height"].get<int>());
+            window_settings.map_width = settings_file["map_width"];
+            window_settings.map_height = settings_file["map_height"];
 
             sim_settings.move_speed = settings_file["move_speed"];
             sim_settings.turn_speed = settings_file["turn_speed"];
@@ -209,6 +377,117 @@ class Simulation {
             sim_settings.b = settings_file["color_b"] / 255.0f;
             sim_settings.decay_rate = settings_file["decay_rate"];
             sim_settings.diffuse_rate = settings_file["diffuse_rate"];
+
+            // the map of a run with dishes is their grid, and every dish is an entry of the species table
+            if (read_dishes(settings_file, species, kernels, AGENT_COUNT) > 1) {
+                if (kernels.species_count > 1)
+                    fprintf(stderr, "Every dish runs a single species, the species list is ignored.\n");
+                kernels.species_count = 1;
+
+                sim_settings.width = kernels.dish_columns * kernels.dish_width;
+                sim_settings.height = dish_rows(kernels) * kernels.dish_height;
+                window_settings.map_width = sim_settings.width;
+                window_settings.map_height = sim_settings.height;
+                window_settings.width = settings_file.value("window_width", sim_settings.width);
+                window_settings.height = settings_file.value("window_height", sim_settings.height);
+            }
+
+            // a missing or zero seed picks a random one, it gets printed so the run can be reproduced
+            seed = settings_file.value("seed", (uint64_t)0);
+            if (seed == 0) {
+                std::random_device rd;
+                seed = ((uint64_t)rd() << 32) | rd();
+                fprintf(stderr, "seed: %llu\n", (unsigned long long)seed);
+            }
+            philox_key key = make_philox_key(seed);
+            sim_settings.seed_lo = key.k0;
+            sim_settings.seed_hi = key.k1;
+
+            steps_per_frame = settings_file.value("steps_per_frame", 1);
+            steps_per_second = settings_file.value("steps_per_second", 0.0);
+            window_settings.swap_interval = settings_file.value("swap_interval", 1);
+            max_fps = settings_file.value("max_fps", 0.0);
+            cpu_budget = settings_file.value("cpu_budget", 0.0);
+
+            checkpoint_path = settings_file.value("checkpoint_path", std::string("./checkpoint.slime"));
+            checkpoint_every = settings_file.value("checkpoint_every", 0);
+
+            series_path = settings_file.value("series_path", std::string("./series.slimes"));
+            series_every = settings_file.value("series_every", 0);
+            series_keyframe_every = settings_file.value("series_keyframe_every", 32);
+            series_threads = settings_file.value("series_threads", 0);
+
+            recorder_frames = settings_file.value("recorder_frames", 0);
+            recorder_every = std::max(1, settings_file.value("recorder_every", 1));
+            recorder_downsample = settings_file.value("recorder_downsample", 4);
+            recorder_agent_stride = settings_file.value("recorder_agent_stride", 1024);
+            recorder_prefix = settings_file.value("recorder_prefix", std::string("./flight_"));
+
+            trajectory_path = settings_file.value("trajectory_path", std::string("./trajectories.traj"));
+            trajectory_stride = settings_file.value("trajectory_stride", 0);
+            trajectory_ids = settings_file.value("trajectory_ids", std::vector<uint32_t>());
+            trajectory_batch = settings_file.value("trajectory_batch", 64);
+
+            capture_source = settings_file.value("capture_source", std::string("trail")) == "frame" ? CAPTURE_FRAME : CAPTURE_TRAIL;
+            capture_every = std::max(1, settings_file.value("capture_every", 1));
+            capture_buffers = settings_file.value("capture_buffers", 3);
+            capture_sink = settings_file.value("capture_sink", std::string(""));
+            capture_path = settings_file.value("capture_path", std::string("./capture.y4m"));
+            capture_queue = settings_file.value("capture_queue", 1);
+            capture_drop = settings_file.value("capture_drop", std::string("oldest")) == "newest" ? DROP_NEWEST : DROP_OLDEST;
+            video_fps = settings_file.value("video_fps", 60);
+            image_prefix = settings_file.value("image_prefix", std::string("./frame_"));
+            image_threads = settings_file.value("image_threads", 0);
+            tone_curve = settings_file.value("tone_curve", 0.0f);
+
+            sparse_diffusion = settings_file.value("sparse_diffusion", true);
+            lazy_decay = settings_file.value("lazy_decay", false);
+            lazy_idle_steps = std::max(1, settings_file.value("lazy_idle_steps", 64));
+            kernels.sensor_size = std::max(1, settings_file.value("sensor_size", 3)) | 1;
+            sat_sensing = settings_file.value("sat_sensing", false);
+            mip_sensing = settings_file.value("mip_sensing", false);
+            blur_sensing = settings_file.value("blur_sensing", false);
+
+            kernels.boundary_mode = parse_boundary(settings_file.value("boundary", std::string("clamp")));
+            kernels.trail_precision = parse_trail_precision(settings_file.value("trail_precision", std::string("f32")));
+            kernels.draw_agents = settings_file.value("draw_agents", true);
+            kernels.ghost_cells = settings_file.value("diffusion_blur", std::string("direct")) == "ghost";
+            kernels.pow2_map = kernels.dish_count > 1 ? is_pow2(kernels.dish_width) && is_pow2(kernels.dish_height) :
+                is_pow2(sim_settings.width) && is_pow2(sim_settings.height);
+            diffusion_substeps = std::min(max_substeps, std::max(1, settings_file.value("diffusion_substeps", 1)));
+            if (lazy_decay && diffusion_substeps > 1) {
+                fprintf(stderr, "lazy_decay doesn't work with diffusion_substeps, it is turned off.\n");
+                lazy_decay = false;
+            }
+            if (blur_sensing && (sat_sensing || mip_sensing || lazy_decay || diffusion_substeps > 1 || kernels.sensor_size != 3)) {
+                fprintf(stderr, "blur_sensing reads the sums of the 3x3 blur, sat_sensing, mip_sensing, lazy_decay and diffusion_substeps are turned off"
+                    " and sensor_size is 3.\n");
+                sat_sensing = mip_sensing = lazy_decay = false;
+                diffusion_substeps = 1;
+                kernels.sensor_size = 3;
+            }
+            if (mip_sensing && (lazy_decay || sat_sensing)) {
+                fprintf(stderr, "mip_sensing doesn't work with lazy_decay or sat_sensing, they are turned off.\n");
+                lazy_decay = false;
+                sat_sensing = false;
+            }
+            // lazy decay stores the trail with the decay it still owes added on, which can go past the 1 a u16 map holds,
+            // and in f16 the small trail left under a large owed decay loses most of its bits
+            if (kernels.trail_precision != TRAIL_F32 && lazy_decay) {
+                fprintf(stderr, "lazy_decay only works with the f32 trail_precision, it is turned off.\n");
+                lazy_decay = false;
+            }
+            // every species owns a channel of the trail map, so nothing that sums the four channels together can sense it
+            if (kernels.species_count > 1 && (lazy_decay || sat_sensing || blur_sensing)) {
+                fprintf(stderr, "lazy_decay, sat_sensing and blur_sensing don't work with more than one species, they are turned off.\n");
+                lazy_decay = sat_sensing = blur_sensing = false;
+            }
+            // lazy decay owes every tile the one decay rate, and the pyramid's coarse levels blur one dish into the next
+            if (kernels.dish_count > 1 && (lazy_decay || mip_sensing)) {
+                fprintf(stderr, "lazy_decay and mip_sensing don't work with dishes, they are turned off.\n");
+                lazy_decay = mip_sensing = false;
+            }
+            trail_format = kernels.trail_precision == TRAIL_F16 ? GL_RGBA16F : kernels.trail_precision == TRAIL_U16 ? GL_RGBA16 : GL_RGBA32F;
         }
         /*
             init_buffer function
@@ -262,16 +541,27 @@ class Simulation {
         */
         void init_textures() {
             glGenTextures(1, &trail_texture);
+            glGenTextures(1, &trail_scratch);
             glGenTextures(1, &agent_texture);
 
-            // trail texture
-            glBindTexture(GL_TEXTURE_2D, trail_texture);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            // trail texture, filtered when the map is shrunk into a smaller window
+            // the scratch texture takes turns with it, so it is made the same way
+            GLuint trail_textures[2] = { trail_texture, trail_scratch };
+            for (GLuint texture : trail_textures) {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+                glTexImage2D(GL_TEXTURE_2D, 0, trail_format, sim_settings.width, sim_settings.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            }
 
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, window_settings.width, window_settings.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            // tiles that never see trail are never diffused, so the map has to start cleared
+            // with one species the diffusion keeps alpha at 1 and the sensors sum it, so it starts at 1 too,
+            // otherwise the untouched tiles would sense lower than the diffused ones and turn the agents away
+            float clearVal[4] = { 0.0f, 0.0f, 0.0f, kernels.species_count == 1 ? 1.0f : 0.0f };
+            glClearTexImage(trail_texture, 0, GL_RGBA, GL_FLOAT, clearVal);
 
             // agent texture
             glBindTexture(GL_TEXTURE_2D, agent_texture);
@@ -280,60 +570,193 @@ class Simulation {
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, window_settings.width, window_settings.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, sim_settings.width, sim_settings.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
             float alphaVal[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
             glClearTexImage(agent_texture, 0, GL_RGBA, GL_FLOAT, alphaVal);
+
+            init_blur();
+        }
+        /*
+            init_blur function
+
+            description:
+                (re)makes the texture the diffusion pass keeps its 3x3 sums in, only when blur_sensing is on
+        */
+        void init_blur() {
+            glDeleteTextures(1, &blur_texture);
+            blur_texture = 0;
+            if (!blur_sensing)
+                return;
+
+            glCreateTextures(GL_TEXTURE_2D, 1, &blur_texture);
+            glTextureStorage2D(blur_texture, 1, GL_R32F, sim_settings.width, sim_settings.height);
+            float clearVal = 0.0f;
+            glClearTexImage(blur_texture, 0, GL_RED, GL_FLOAT, &clearVal);
+        }
+        /*
+            init_tiles function
+
+            description:
+                (re)makes the tile buffers for the current map size
+                every tile starts active, so the first step diffuses the whole map whatever is in it
+                and every tile starts up to date as of the last step taken
+        */
+        void init_tiles() {
+            glDeleteBuffers(1, &tileSSBO);
+            glDeleteBuffers(1, &tileListSSBO);
+            glDeleteBuffers(1, &tileStampSSBO);
+
+            tiles_x = (sim_settings.width + tile_size - 1) / tile_size;
+            tiles_y = (sim_settings.height + tile_size - 1) / tile_size;
+
+            std::vector<GLuint> active(tiles_x * tiles_y, step_count + 1);
+            glCreateBuffers(1, &tileSSBO);
+            glNamedBufferStorage(tileSSBO, active.size() * sizeof(GLuint), active.data(), GL_DYNAMIC_STORAGE_BIT);
+
+            std::vector<GLint> stamps(active.size(), (GLint)step_count - 1);
+            glCreateBuffers(1, &tileStampSSBO);
+            glNamedBufferStorage(tileStampSSBO, stamps.size() * sizeof(GLint), stamps.data(), GL_DYNAMIC_STORAGE_BIT);
+
+            GLuint arguments[3] = { 0, 1, 1 };
+            glCreateBuffers(1, &tileListSSBO);
+            glNamedBufferStorage(tileListSSBO, (3 + active.size()) * sizeof(GLuint), NULL, GL_DYNAMIC_STORAGE_BIT);
+            glNamedBufferSubData(tileListSSBO, 0, sizeof(arguments), arguments);
+        }
+        /*
+            init_sat function
+
+            description:
+                (re)makes the summed area table for the current map size, only when sat_sensing is on
+        */
+        void init_sat() {
+            glDeleteBuffers(1, &satSSBO);
+            satSSBO = 0;
+            if (!sat_sensing)
+                return;
+
+            glCreateBuffers(1, &satSSBO);
+            glNamedBufferStorage(satSSBO, (GLsizeiptr)sim_settings.width * sim_settings.height * sizeof(GLuint), NULL, 0);
+        }
+        /*
+            init_species function
+
+            description:
+                (re)fills the species SSBO, a single species is made from the settings so it follows a loaded snapshot
+                with dishes the table was filled by read_dishes and only needs uploading
+        */
+        void init_species() {
+            if (kernels.species_count == 1 && kernels.dish_count == 1) {
+                species.assign(1, legacy_species(sim_settings.move_speed, sim_settings.turn_speed, sim_settings.sensor_angle,
+                    sim_settings.sensor_distance, sim_settings.r, sim_settings.g, sim_settings.b, sim_settings.decay_rate, sim_settings.diffuse_rate));
+            }
+
+            if (!speciesSSBO)
+                glCreateBuffers(1, &speciesSSBO);
+            glNamedBufferData(speciesSSBO, species.size() * sizeof(species_settings), species.data(), GL_STATIC_DRAW);
+        }
+        /*
+            init_shaders function
+
+            description:
+                (re)compiles the compute shaders for the options this run uses, so they don't branch on the others
+        */
+        void init_shaders() {
+            delete compute;
+            delete diffuse;
+            delete tiles;
+            delete rebase;
+            delete copy_tiles;
+            delete diffuse_blocked;
+            delete sat_scan;
+
+            std::string defines = kernel_defines(kernels);
+            compute = new ComputeShader("./shaders/slime_mold.glsl", defines);
+            diffuse = new ComputeShader("./shaders/diffuse.glsl", defines);
+            tiles = new ComputeShader("./shaders/tiles.glsl");
+            rebase = new ComputeShader("./shaders/rebase.glsl", defines);
+            copy_tiles = new ComputeShader("./shaders/copy_tiles.glsl", defines);
+            diffuse_blocked = new ComputeShader("./shaders/diffuse_blocked.glsl", defines);
+            sat_scan = new ComputeShader("./shaders/sat.glsl", defines);
         }
         /*
             init_agents function
 
             description:
-               positions the agents based on the spawn method using random functions 
+               positions the agents based on the spawn method, see spawn.h
+               with dishes every dish is spawned the same way, so the dishes start alike and only their settings differ
         */
         void init_agents() {
-            std::random_device rd;
-            std::mt19937 gen(rd());
-
-            for (int i = 0; i < AGENT_COUNT; i++) {
-                int center_x = window_settings.width / 2;
-                int center_y = window_settings.height / 2;
-
-                if (this->spawn_method == "center") {
-                    std::uniform_real_distribution<> randomAngle(0, 12.5662);
-                    agent_array[i].x = center_x;
-                    agent_array[i].y = center_y;
-                    agent_array[i].angle = randomAngle(gen);
-                } else if (spawn_method == "random") {
-                    std::uniform_real_distribution<> randomAngle(0, 6.2831);
-                    std::uniform_int_distribution<> randomX(0, window_settings.width);
-                    std::uniform_int_distribution<> randomY(0, window_settings.height);
-
-                    agent_array[i].x = randomX(gen);
-                    agent_array[i].y = randomY(gen);
-                    agent_array[i].angle = randomAngle(gen);
-                } else if(spawn_method == "circle") {
-                    std::uniform_real_distribution<> randomAngle(0, 6.2831);
-                    std::uniform_int_distribution<> randomR(0, (window_settings.width + window_settings.height) / 10);
-
-                    float radius = randomR(gen);
-                    float spawn_angle = randomAngle(gen);
-
-                    agent_array[i].angle = randomAngle(gen);
-                    agent_array[i].x = center_x + radius * cos(spawn_angle);
-                    agent_array[i].y = center_y + radius * sin(spawn_angle);
-                    
-                } else if (spawn_method == "ring") {
-                    std::uniform_real_distribution<> randomAngle(0, 6.2831);
-
-                    float radius = (window_settings.width + window_settings.height) / 10;
-                    float spawn_angle = randomAngle(gen);
-
-                    agent_array[i].angle = randomAngle(gen);
-                    agent_array[i].x = center_x + radius * cos(spawn_angle);
-                    agent_array[i].y = center_y + radius * sin(spawn_angle);
+            if (kernels.dish_count == 1) {
+                spawn_agents(agent_array, AGENT_COUNT, spawn_method, sim_settings.width, sim_settings.height, seed);
+                return;
+            }
+
+            spawn_agents(agent_array, kernels.dish_agents, spawn_method, kernels.dish_width, kernels.dish_height, seed);
+            for (int dish = 1; dish < kernels.dish_count; dish++) {
+                agent* first = agent_array + dish * kernels.dish_agents;
+                float corner_x = (float)(dish % kernels.dish_columns * kernels.dish_width);
+                float corner_y = (float)(dish / kernels.dish_columns * kernels.dish_height);
+                for (int i = 0; i < kernels.dish_agents; i++) {
+                    first[i] = agent_array[i];
+                    first[i].x += corner_x;
+                    first[i].y += corner_y;
+                }
+            }
+        }
+
+        /*
+            init_capture function
 
+            description:
+                makes the frame sink the settings ask for, if any, and turns on frame capture for it
+        */
+        void init_capture() {
+            if (capture_sink == "y4m" || capture_sink == "raw") {
+                int format = capture_sink == "y4m" ? VIDEO_Y4M : VIDEO_RAW;
+                set_frame_sink(new VideoSink(capture_path, format, video_fps, capture_queue, capture_drop));
+            } else if (capture_sink == "png" || capture_sink == "exr") {
+                if (capture_sink == "exr" && capture_source != CAPTURE_TRAIL) {
+                    fprintf(stderr, "Exr dumps need the trail capture source, frame capture is off.\n");
+                    return;
                 }
+                int format = capture_sink == "png" ? IMAGE_PNG : IMAGE_EXR;
+                set_frame_sink(new ImageWriter(image_prefix, format, image_threads, capture_queue, tone_curve));
+            } else if (!capture_sink.empty()) {
+                fprintf(stderr, "Unknown capture sink %s, frame capture is off.\n", capture_sink.c_str());
+            }
+        }
+
+        /*
+            init_trajectory function
+
+            description:
+                makes the trajectory probe for the agents the settings ask for, replacing the old one
+        */
+        void init_trajectory() {
+            delete trajectory;
+            trajectory = NULL;
+
+            std::vector<uint32_t> ids;
+            for (int i = 0; trajectory_stride > 0 && i < AGENT_COUNT; i += trajectory_stride)
+                ids.push_back((uint32_t)i);
+            ids.insert(ids.end(), trajectory_ids.begin(), trajectory_ids.end());
+            if (!ids.empty())
+                trajectory = new TrajectoryProbe(ids, AGENT_COUNT, trajectory_batch, trajectory_path, seed);
+        }
+        /*
+            init_recorder function
+
+            description:
+                makes the flight recorder for the current map size and agent count, replacing the old one
+        */
+        void init_recorder() {
+            delete recorder;
+            recorder = NULL;
+            if (recorder_frames > 0) {
+                recorder = new FlightRecorder(recorder_frames, recorder_downsample, recorder_agent_stride,
+                    sim_settings.width, sim_settings.height, AGENT_COUNT, sizeof(agent), seed, recorder_prefix,
+                    trail_format, kernel_defines(kernels));
             }
         }
 
@@ -359,6 +782,16 @@ class Simulation {
             glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
             glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+            // shrink the window to fit on the monitor, a big map is previewed in a smaller window
+            const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+            if (mode) {
+                float fit = std::min(0.9f * mode->width / window_settings.width, 0.9f * mode->height / window_settings.height);
+                if (fit < 1) {
+                    window_settings.width = std::max(1, (int)(window_settings.width * fit));
+                    window_settings.height = std::max(1, (int)(window_settings.height * fit));
+                }
+            }
+
             simulation_window = glfwCreateWindow(window_settings.width, window_settings.height, "Slime Mold Simulation", NULL, NULL);
             if (simulation_window == NULL) {
                 fprintf(stderr, "Failed to open GLFW window.\n");
@@ -377,16 +810,45 @@ class Simulation {
                 exit(GLEW_INIT_FAIL);
             }
 
+            glfwSwapInterval(window_settings.swap_interval);
+            scheduler.configure(steps_per_frame, steps_per_second, mode ? mode->refreshRate : 0, max_fps, cpu_budget);
+
+            // fit the map into the framebuffer the window actually got
+            int framebuffer_width, framebuffer_height;
+            glfwGetFramebufferSize(simulation_window, &framebuffer_width, &framebuffer_height);
+            frame_callback(simulation_window, framebuffer_width, framebuffer_height);
+
             display = new DisplayShader();
-            compute = new ComputeShader();
+            init_shaders();
+
+            glCreateSamplers(1, &pyramid_sampler);
+            glSamplerParameteri(pyramid_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glSamplerParameteri(pyramid_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            GLint pyramid_wrap = kernels.boundary_mode == BOUNDARY_WRAP ? GL_REPEAT : kernels.boundary_mode == BOUNDARY_ZERO ? GL_CLAMP_TO_BORDER : GL_CLAMP_TO_EDGE;
+            glSamplerParameteri(pyramid_sampler, GL_TEXTURE_WRAP_S, pyramid_wrap);
+            glSamplerParameteri(pyramid_sampler, GL_TEXTURE_WRAP_T, pyramid_wrap);
+
+            checkpointer = new Checkpointer(checkpoint_path);
+            if (series_every > 0) {
+                SeriesWriter* writer = series_writer = new SeriesWriter(series_path, series_keyframe_every, series_threads);
+                series_recorder = new Checkpointer("series record",
+                    [writer](const snapshot_header& header, const void* settings, const void* agents, const void* trail) {
+                        return writer->append(header, settings, agents, trail);
+                    });
+            }
+            init_capture();
 
             init_buffers();
             init_textures();
+            init_tiles();
+            init_sat();
 
             glGenBuffers(1, &settingsSSBO);
             glBindBuffer(GL_SHADER_STORAGE_BUFFER, settingsSSBO);
             glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(sim_settings), &sim_settings, GL_STATIC_DRAW);
 
+            init_species();
+
             agent_array = (agent*)malloc(AGENT_COUNT * sizeof(agent));
             init_agents();
 
@@ -394,6 +856,9 @@ class Simulation {
             glBindBuffer(GL_SHADER_STORAGE_BUFFER, agentSSBO);
             glBufferData(GL_SHADER_STORAGE_BUFFER, AGENT_COUNT * sizeof(agent), agent_array, GL_DYNAMIC_READ);
 
+            init_recorder();
+            init_trajectory();
+
             glBindVertexArray(0);
             glBindBuffer(GL_ARRAY_BUFFER, 0);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -407,16 +872,632 @@ class Simulation {
                 handles the destruction of the pointers within the program
         */
         ~Simulation() {
-            delete display, compute;
+            // the reads in flight go to the sink, and the sink finishes with them before the buffers go away
+            if (capture)
+                capture->poll(frame_sink, true);
+            delete frame_sink;
+            delete capture;
+
+            delete checkpointer;
+            delete series_recorder;
+            delete series_writer;
+            delete recorder;
+            delete trajectory;
+            delete display;
+            delete compute;
+            delete diffuse;
+            delete tiles;
+            delete rebase;
+            delete copy_tiles;
+            delete diffuse_blocked;
+            delete sat_scan;
+            glDeleteSamplers(1, &pyramid_sampler);
             free(agent_array);
             glfwTerminate();
         }
 
+        /*
+            step function
+
+            takes in whether the agent map should be cleared before the agents are drawn into it
+
+            description:
+                advances the simulation by one step, first diffusing and decaying the trail map and then moving the agents
+        */
+        void step(bool clear_agents) {
+            if (diffuse_query)
+                glBeginQuery(GL_TIME_ELAPSED, diffuse_query);
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, tileSSBO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, tileListSSBO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, tileStampSSBO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, speciesSSBO);
+
+            if (diffusion_substeps > 1) {
+                diffuse_substeps();
+            } else {
+                const GLuint zero = 0;
+
+                // the sums have to be right everywhere for blur_sensing, so it diffuses the whole map
+                bool sparse = sparse_diffusion && !blur_sensing;
+
+                // list the tiles that hold trail or are next to one that does
+                // with lazy decay, the tiles deposited in during the last lazy_idle_steps steps or next to one that was
+                if (sparse) {
+                    glClearNamedBufferSubData(tileListSSBO, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+                    tiles->use();
+                    glUniform2i(glGetUniformLocation(tiles->program_id, "tile_count"), tiles_x, tiles_y);
+                    tiles->set_uint("current_step", step_count);
+                    tiles->set_uint("idle_steps", lazy_decay ? lazy_idle_steps : 0);
+                    tiles->set_bool("wrap", kernels.boundary_mode == BOUNDARY_WRAP);
+                    if (kernels.dish_count > 1)
+                        glUniform2i(glGetUniformLocation(tiles->program_id, "dish_tiles"), kernels.dish_width / tile_size, kernels.dish_height / tile_size);
+                    else
+                        glUniform2i(glGetUniformLocation(tiles->program_id, "dish_tiles"), tiles_x, tiles_y);
+                    tiles->dispatch((tiles_x * tiles_y + 63) / 64, 1);
+
+                    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+                }
+
+                // the flags are set again by this step's diffusion and deposits, lazy decay keeps the step of the last deposit instead
+                if (!lazy_decay)
+                    glClearNamedBufferData(tileSSBO, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+                // run the diffusion compute shader over the listed tiles, or the whole map
+                // it reads trail_texture and writes trail_scratch, so the ghost cells are always the last step's trail
+                diffuse->use();
+
+                glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_READ_ONLY, trail_format);
+                glBindImageTexture(2, trail_scratch, 0, GL_FALSE, 0, GL_WRITE_ONLY, trail_format);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, settingsSSBO);
+                diffuse->set_bool("sparse", sparse);
+                diffuse->set_bool("lazy", lazy_decay);
+                diffuse->set_int("decay_step", (int)step_count);
+                diffuse->set_bool("store_blur", blur_sensing);
+                if (blur_sensing)
+                    glBindImageTexture(3, blur_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+                if (sparse) {
+                    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, tileListSSBO);
+                    glDispatchComputeIndirect(0);
+                    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+                    // only the listed tiles of the scratch map are new, so they are copied back instead of swapping
+                    copy_tiles->use();
+                    glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, trail_format);
+                    glBindImageTexture(2, trail_scratch, 0, GL_FALSE, 0, GL_READ_ONLY, trail_format);
+                    glDispatchComputeIndirect(0);
+                    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+                } else {
+                    diffuse->dispatch(tiles_x, tiles_y);
+                }
+
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT |
+                    GL_SHADER_STORAGE_BARRIER_BIT);
+                if (!sparse)
+                    std::swap(trail_texture, trail_scratch);
+
+                // the diffused tiles were stored still owing their decay, so settle them and move their stamps on
+                if (lazy_decay) {
+                    rebase_tiles(sparse, (int)step_count);
+                    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+                }
+            }
+
+            if (diffuse_query)
+                glEndQuery(GL_TIME_ELAPSED);
+
+            // only the agents of the last step before a present get drawn, and none at all without draw_agents
+            if (clear_agents && kernels.draw_agents) {
+                float alphaVal[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                glClearTexImage(agent_texture, 0, GL_RGBA, GL_FLOAT, alphaVal);
+            }
+
+            if (sat_sensing)
+                build_sat();
+
+            // the pyramid is rebuilt from the diffused map, the display keeps sampling level 0 only
+            if (mip_sensing) {
+                glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+                glGenerateTextureMipmap(trail_texture);
+                glBindTextureUnit(3, trail_texture);
+                glBindSampler(3, pyramid_sampler);
+            }
+
+            // run agent compute shader
+            if (agent_query)
+                glBeginQuery(GL_TIME_ELAPSED, agent_query);
+            compute->use();
+
+            glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_READ_WRITE, trail_format);
+            glBindImageTexture(2, agent_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, settingsSSBO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, agentSSBO);
+
+            compute->set_uint("step_index", step_count);
+            compute->set_bool("lazy", lazy_decay);
+            compute->set_bool("sat_sensing", sat_sensing);
+            compute->set_bool("mip_sensing", mip_sensing);
+            compute->set_bool("blur_sensing", blur_sensing);
+            if (blur_sensing)
+                glBindImageTexture(3, blur_texture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            if (sat_sensing)
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, satSSBO);
+
+            // one invocation per agent, the last group is cut short by the check in the shader
+            const int compute_divisor = 256; // local_size_x in slime_mold.glsl
+            compute->dispatch((AGENT_COUNT + compute_divisor - 1) / compute_divisor, 1);
+            if (agent_query)
+                glEndQuery(GL_TIME_ELAPSED);
+            step_count++;
+
+            glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+            if (recorder && step_count % recorder_every == 0) {
+                if (recorder_query)
+                    glBeginQuery(GL_TIME_ELAPSED, recorder_query);
+                recorder->record(trail_texture, lazy_decay ? tileStampSSBO : 0, sim_settings.decay_rate, agentSSBO, step_count);
+                if (recorder_query)
+                    glEndQuery(GL_TIME_ELAPSED);
+            }
+            if (trajectory)
+                trajectory->record(agentSSBO, step_count);
+        }
+        /*
+            diffuse_substeps function
+
+            description:
+                runs diffusion_substeps diffusion steps in one pass, every work group loads its tile with a halo
+                as wide as the substeps into shared memory and only writes the tile back after the last substep
+                so the map goes through memory once instead of once a substep
+                the pass reads trail_texture and writes trail_scratch, then the two are swapped
+        */
+        void diffuse_substeps() {
+            const GLuint zero = 0;
+            glClearNamedBufferData(tileSSBO, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+            diffuse_blocked->use();
+
+            glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_READ_ONLY, trail_format);
+            glBindImageTexture(2, trail_scratch, 0, GL_FALSE, 0, GL_WRITE_ONLY, trail_format);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, settingsSSBO);
+            diffuse_blocked->set_int("substeps", diffusion_substeps);
+            diffuse_blocked->dispatch(tiles_x, tiles_y);
+
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT |
+                GL_SHADER_STORAGE_BARRIER_BIT);
+            std::swap(trail_texture, trail_scratch);
+        }
+        /*
+            build_sat function
+
+            description:
+                builds the summed area table of the diffused trail map, one work group scans each row
+                and then one work group scans each column, see sat.glsl
+        */
+        void build_sat() {
+            sat_scan->use();
+
+            glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_READ_ONLY, trail_format);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, tileStampSSBO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, satSSBO);
+            glUniform2i(glGetUniformLocation(sat_scan->program_id, "map_size"), sim_settings.width, sim_settings.height);
+            sat_scan->set_bool("lazy", lazy_decay);
+            sat_scan->set_float("decay_rate", sim_settings.decay_rate);
+            sat_scan->set_int("decay_step", (int)step_count);
+
+            sat_scan->set_int("scan_pass", 0);
+            sat_scan->dispatch(sim_settings.height, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            sat_scan->set_int("scan_pass", 1);
+            sat_scan->dispatch(sim_settings.width, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        /*
+            rebase_tiles function
+
+            takes in whether only the listed tiles are rebased and the step they are brought up to
+
+            description:
+                takes the decay each tile still owes off its trail and moves its stamp on to the step
+        */
+        void rebase_tiles(bool listed_only, int decay_step) {
+            rebase->use();
+
+            glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_READ_WRITE, trail_format);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, settingsSSBO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, tileListSSBO);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, tileStampSSBO);
+            rebase->set_bool("sparse", listed_only);
+            rebase->set_int("decay_step", decay_step);
+
+            if (listed_only) {
+                glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, tileListSSBO);
+                glDispatchComputeIndirect(0);
+                glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+            } else {
+                rebase->dispatch(tiles_x, tiles_y);
+            }
+        }
+        /*
+            settle_trail function
+
+            description:
+                with lazy decay, brings every tile of the trail map up to date
+                so the trail texture can be read back as it is, called before snapshots and trail captures
+        */
+        void settle_trail() {
+            if (!lazy_decay)
+                return;
+            rebase_tiles(false, (int)step_count - 1);
+            glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        }
+        /*
+            present function
+
+            description:
+                draws the trail and agent maps to the window and swaps the buffers
+                the maps are sampled as textures, so the cost follows the window size and not the map size
+        */
+        void present() {
+            // Clear the screen
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            // a map shrunk into the window is drawn from mip pyramids of both maps, so every texel is averaged in
+            // instead of the few a bilinear tap lands on, with lazy decay the map is brought up to date first
+            bool shrunk = window_settings.map_shrunk;
+            bool agent_mips = shrunk && kernels.draw_agents;
+            if (shrunk) {
+                settle_trail();
+                glGenerateTextureMipmap(trail_texture);
+                if (agent_mips)
+                    glGenerateTextureMipmap(agent_texture);
+            }
+            glTextureParameteri(trail_texture, GL_TEXTURE_MIN_FILTER, shrunk ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            glTextureParameteri(agent_texture, GL_TEXTURE_MIN_FILTER, agent_mips ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+
+            // run vertex and fragment shader
+            display->use();
+            glBindVertexArray(VAO);
+
+            // with lazy decay the fragment shader takes the owed decay off as it samples
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, tileStampSSBO);
+            display->set_bool("lazy", lazy_decay && !shrunk);
+            display->set_float("decay_rate", sim_settings.decay_rate);
+            display->set_int("decay_step", (int)step_count - 1);
+
+            // with several species the trail map holds one species per channel, this turns them into colours
+            float species_colors[16];
+            species_color_matrix(species, kernels.species_count, species_colors);
+            display->set_mat4("species_colors", species_colors);
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, trail_texture);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, agent_texture);
+
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+            // queue a capture of this frame, it reaches the sink a frame or two later
+            if (capture && presented_frames % capture_every == 0) {
+                if (capture_source == CAPTURE_TRAIL)
+                    settle_trail();
+                capture->capture(trail_texture, sim_settings.width, sim_settings.height, step_count);
+            }
+            presented_frames++;
+
+            // Swap buffers
+            glfwSwapBuffers(simulation_window);
+        }
+        /*
+            report function
+
+            description:
+                puts the frame rate, step rate and cpu use from the scheduler in the window title once per report period
+        */
+        void report() {
+            scheduler_report stats;
+            if (!scheduler.report(glfwGetTime(), stats))
+                return;
+
+            char title[256];
+            if (window_settings.paused) {
+                snprintf(title, sizeof(title), "Slime Mold Simulation - paused - cpu %.1f%%", stats.cpu_percent);
+            } else {
+                snprintf(title, sizeof(title), "Slime Mold Simulation - %.0f fps - %.0f steps/s - cpu %.1f%%",
+                    stats.frames_per_second, stats.steps_per_second, stats.cpu_percent);
+            }
+            if (stats.over_budget) {
+                size_t length = strlen(title);
+                snprintf(title + length, sizeof(title) - length, " (over the %.0f%% budget)", scheduler.budget());
+            }
+            glfwSetWindowTitle(simulation_window, title);
+        }
+        /*
+            save function
+
+            takes in the path to write the snapshot to
+            returns true if the snapshot was written
+
+            description:
+                reads the agent buffer and the trail map back from the gpu and writes them with the settings
+                and the random number state, see snapshot.h for the layout
+        */
+        bool save(const std::string& path) {
+            // the trail is saved as 32 bit floats whatever trail_precision is, so snapshots move between precisions
+            snapshot_header header = make_snapshot_header(sim_settings.width, sim_settings.height, AGENT_COUNT, sizeof(agent),
+                sizeof(sim_settings), GL_RGBA32F, 4 * sizeof(float), seed, step_count);
+
+            std::vector<unsigned char> agents((size_t)header.agents.size);
+            std::vector<unsigned char> trail((size_t)header.trail.size);
+
+            settle_trail();
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+            glGetNamedBufferSubData(agentSSBO, 0, (GLsizeiptr)header.agents.size, agents.data());
+            glGetTextureImage(trail_texture, 0, GL_RGBA, GL_FLOAT, (GLsizei)header.trail.size, trail.data());
+
+            return write_snapshot(path, header, &sim_settings, agents.data(), trail.data());
+        }
+        /*
+            set_frame_sink function
+
+            takes in the sink captured frames should go to, the simulation owns it from here on
+
+            description:
+                turns on frame capture with the capture settings from the settings json file
+        */
+        void set_frame_sink(FrameSink* sink) {
+            if (capture) {
+                capture->poll(frame_sink, true);
+                delete frame_sink;
+            } else {
+                capture = new FrameCapture(capture_source, capture_buffers);
+            }
+            frame_sink = sink;
+        }
+        /*
+            checkpoint function
+
+            returns true if the checkpoint was started
+
+            description:
+                the same snapshot as save, but it only queues gpu copies and a writer thread does the rest
+                so the step loop doesn't stall while hundreds of megabytes get written
+        */
+        bool checkpoint() {
+            settle_trail();
+            return checkpointer->request(agentSSBO, trail_texture, &sim_settings, sizeof(sim_settings),
+                sim_settings.width, sim_settings.height, AGENT_COUNT, sizeof(agent), seed, step_count);
+        }
+        /*
+            record_series function
+
+            returns true if the record was started
+
+            description:
+                copies the simulation out the same way as checkpoint, then the series writer compresses it onto the end of the series
+        */
+        bool record_series() {
+            settle_trail();
+            return series_recorder->request(agentSSBO, trail_texture, &sim_settings, sizeof(sim_settings),
+                sim_settings.width, sim_settings.height, AGENT_COUNT, sizeof(agent), seed, step_count);
+        }
+        /*
+            load function
+
+            takes in the path to a snapshot
+            returns true if the snapshot was loaded
+
+            description:
+                memory maps the snapshot and uploads its sections straight from the mapping
+                the settings, agent count, map size and random number state all come from the snapshot
+                the presentation settings (window, scheduler) still come from the settings json file
+        */
+        bool load(const char* path) {
+            MappedSnapshot snapshot;
+            if (!snapshot.open(path))
+                return false;
+
+            const snapshot_header& header = *snapshot.header;
+            if (header.settings.size != sizeof(sim_settings) || header.agent_size != sizeof(agent) || header.trail_format != GL_RGBA32F ||
+                header.trail.size != (uint64_t)header.width * header.height * 4 * sizeof(float)) {
+                fprintf(stderr, "Could not load the snapshot %s: its layout doesn't match this build.\n", path);
+                return false;
+            }
+
+            // the dishes are compiled into the shaders from settings.json, so the snapshot has to be of the same dishes
+            if (kernels.dish_count > 1 && (header.width != sim_settings.width || header.height != sim_settings.height ||
+                header.agent_count != AGENT_COUNT)) {
+                fprintf(stderr, "Could not load the snapshot %s: it isn't of the dishes in settings.json.\n", path);
+                return false;
+            }
+
+            memcpy(&sim_settings, snapshot.settings(), sizeof(sim_settings));
+            AGENT_COUNT = header.agent_count;
+            seed = header.seed;
+            step_count = (unsigned int)header.step;
+
+            // the wrapping is compiled for the map size, so a snapshot of another size may need other shaders
+            bool pow2_map = is_pow2(sim_settings.width) && is_pow2(sim_settings.height);
+            if (kernels.dish_count == 1 && pow2_map != kernels.pow2_map) {
+                kernels.pow2_map = pow2_map;
+                init_shaders();
+            }
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, settingsSSBO);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(sim_settings), &sim_settings, GL_STATIC_DRAW);
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, agentSSBO);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)header.agents.size, snapshot.agents(), GL_DYNAMIC_READ);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            // the map size may have changed, so both textures are respecified
+            glBindTexture(GL_TEXTURE_2D, trail_texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, trail_format, sim_settings.width, sim_settings.height, 0, GL_RGBA, GL_FLOAT, snapshot.trail());
+            glBindTexture(GL_TEXTURE_2D, trail_scratch);
+            glTexImage2D(GL_TEXTURE_2D, 0, trail_format, sim_settings.width, sim_settings.height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glBindTexture(GL_TEXTURE_2D, agent_texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, sim_settings.width, sim_settings.height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glBindTexture(GL_TEXTURE_2D, 0);
+
+            float alphaVal[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            glClearTexImage(agent_texture, 0, GL_RGBA, GL_FLOAT, alphaVal);
+            init_blur();
+            init_tiles();
+            init_sat();
+            init_species();
+
+            window_settings.map_width = sim_settings.width;
+            window_settings.map_height = sim_settings.height;
+            int framebuffer_width, framebuffer_height;
+            glfwGetFramebufferSize(simulation_window, &framebuffer_width, &framebuffer_height);
+            frame_callback(simulation_window, framebuffer_width, framebuffer_height);
+
+            // the recorded steps belong to the run before the snapshot
+            init_recorder();
+            init_trajectory();
+            return true;
+        }
+        /*
+            benchmark function
+
+            takes in the number of steps to time
+
+            description:
+                runs the simulation with the window hidden, switching between full and sparse diffusion every step
+                so both see the same map, and times the diffusion and the agent pass of every step on the gpu
+                every tenth of the run it prints the average time of each and the share of the tiles that were active,
+                so an early sparse map and a late dense one can be compared in one run
+                the agent pass is timed with the boundary the settings ask for, so bouncing, wrapping with a divide
+                and wrapping with a mask are compared by running it once for each
+                the flight recorder pass is timed too, with its share of the whole step, and when the settings turn
+                the recorder off one with the default 240 frames is made for the run so its cost can still be seen
+                a few checkpoints are taken every tenth of the run, to a scratch file next to "checkpoint_path",
+                and the steps that take one are timed apart from the rest, with the slowest step on the wall clock,
+                so the jitter a checkpoint puts into the step loop can be seen
+        */
+        void benchmark(int steps) {
+            glfwHideWindow(simulation_window);
+            bool sparse_setting = sparse_diffusion;
+            int recorder_setting = recorder_frames;
+            if (!recorder) {
+                recorder_frames = 240;
+                init_recorder();
+            }
+
+            // checkpoints go to a scratch file through their own checkpointer, so the real one is left alone
+            std::string scratch_path = checkpoint_path + ".benchmark";
+            Checkpointer* checkpoint_setting = checkpointer;
+            checkpointer = new Checkpointer("benchmark checkpoint",
+                [scratch_path](const snapshot_header& header, const void* settings, const void* agents, const void* trail) {
+                    return write_snapshot(scratch_path, header, settings, agents, trail);
+                });
+
+            GLuint queries[6];
+            glGenQueries(6, queries);
+            double elapsed[2] = { 0, 0 }; // nanoseconds spent diffusing, full then sparse
+            int timed[2] = { 0, 0 }; // the steps timed in each mode
+            double agent_elapsed = 0; // nanoseconds spent in the agent pass
+            double recorder_elapsed = 0; // nanoseconds spent in the flight recorder pass
+            double step_elapsed = 0; // nanoseconds from the start to the end of every step, all passes included
+            long long active_tiles = 0;
+            int period = std::max(1, steps / 10);
+            int period_start = 0;
+            int checkpoint_period = std::max(2, period / 4); // four checkpoints every tenth of the run
+            double checkpoint_step_elapsed = 0; // nanoseconds spent in the steps that took a checkpoint
+            int checkpoint_steps = 0;
+            double slowest_step = 0; // seconds, the slowest step on the wall clock
+
+            const char* edges = kernels.boundary_mode != BOUNDARY_WRAP ? "bounce" : kernels.pow2_map ? "wrap (mask)" : "wrap (divide)";
+            fprintf(stderr, "agents at the edges: %s\n", edges);
+            fprintf(stderr, "steps          full (ms)  %s (ms)  active tiles  agents (ms)  recorder (ms)  of the step"
+                "  step (ms)  checkpoint step (ms)  slowest (ms)\n", lazy_decay ? "  lazy" : "sparse");
+            agent_query = queries[2];
+            recorder_query = queries[3];
+            for (int i = 0; i < steps; i++) {
+                int mode = i % 2;
+                sparse_diffusion = mode == 1;
+                diffuse_query = queries[mode];
+                bool checkpointed = (i + 1) % checkpoint_period == 0;
+                double wall_start = glfwGetTime();
+                glQueryCounter(queries[4], GL_TIMESTAMP);
+                step(true);
+                checkpointer->poll();
+                if (checkpointed)
+                    checkpointed = checkpoint();
+                glQueryCounter(queries[5], GL_TIMESTAMP);
+
+                GLuint64 nanoseconds = 0;
+                GLuint64 step_start = 0;
+                glGetQueryObjectui64v(queries[4], GL_QUERY_RESULT, &step_start);
+                glGetQueryObjectui64v(queries[5], GL_QUERY_RESULT, &nanoseconds);
+                slowest_step = std::max(slowest_step, glfwGetTime() - wall_start);
+                if (checkpointed) {
+                    checkpoint_step_elapsed += (double)(nanoseconds - step_start);
+                    checkpoint_steps++;
+                } else {
+                    step_elapsed += (double)(nanoseconds - step_start);
+                }
+                if (step_count % recorder_every == 0) {
+                    glGetQueryObjectui64v(queries[3], GL_QUERY_RESULT, &nanoseconds);
+                    recorder_elapsed += (double)nanoseconds;
+                }
+                glGetQueryObjectui64v(queries[mode], GL_QUERY_RESULT, &nanoseconds);
+                elapsed[mode] += (double)nanoseconds;
+                timed[mode]++;
+                glGetQueryObjectui64v(queries[2], GL_QUERY_RESULT, &nanoseconds);
+                agent_elapsed += (double)nanoseconds;
+                if (mode == 1) {
+                    GLuint listed = 0;
+                    glGetNamedBufferSubData(tileListSSBO, 0, sizeof(listed), &listed);
+                    active_tiles += listed;
+                }
+
+                if ((i + 1) % period == 0 || i + 1 == steps) {
+                    int period_steps = i + 1 - period_start;
+                    timed[0] = std::max(1, timed[0]);
+                    timed[1] = std::max(1, timed[1]);
+                    int plain_steps = std::max(1, period_steps - checkpoint_steps);
+                    double total_step_elapsed = step_elapsed + checkpoint_step_elapsed;
+                    fprintf(stderr, "%6d-%-6d  %9.3f  %11.3f  %11.1f%%  %11.3f  %13.3f  %10.2f%%  %9.3f  %20.3f  %12.3f\n", period_start, i,
+                        elapsed[0] / timed[0] * 1e-6, elapsed[1] / timed[1] * 1e-6,
+                        100.0 * active_tiles / ((double)timed[1] * tiles_x * tiles_y), agent_elapsed / period_steps * 1e-6,
+                        recorder_elapsed / period_steps * 1e-6, 100.0 * recorder_elapsed / std::max(total_step_elapsed, 1.0),
+                        step_elapsed / plain_steps * 1e-6, checkpoint_step_elapsed / std::max(1, checkpoint_steps) * 1e-6,
+                        slowest_step * 1e3);
+                    elapsed[0] = elapsed[1] = agent_elapsed = recorder_elapsed = step_elapsed = checkpoint_step_elapsed = 0;
+                    timed[0] = timed[1] = 0;
+                    checkpoint_steps = 0;
+                    slowest_step = 0;
+                    active_tiles = 0;
+                    period_start = i + 1;
+                }
+            }
+
+            diffuse_query = 0;
+            agent_query = 0;
+            recorder_query = 0;
+            sparse_diffusion = sparse_setting;
+            if (recorder_frames != recorder_setting) {
+                recorder_frames = recorder_setting;
+                init_recorder();
+            }
+            delete checkpointer;
+            checkpointer = checkpoint_setting;
+            remove(scratch_path.c_str());
+            glDeleteQueries(6, queries);
+        }
         /*
             run function
 
             description:
                 used to fun the simulation
+                the scheduler decides how many steps run before every present, so the step rate isn't tied to the refresh rate
+                the loop sleeps in glfwWaitEventsTimeout while paused or while waiting out the frame rate cap
         */
         void run() {
             // Clear the screen
@@ -427,45 +1508,57 @@ class Simulation {
             glClear(GL_COLOR_BUFFER_BIT);
 
             while (!glfwWindowShouldClose(simulation_window)) {
+                report();
+
+                // hand finished checkpoint copies to the writer thread and finished captures to the sink
+                checkpointer->poll();
+                if (series_recorder)
+                    series_recorder->poll();
+                if (trajectory)
+                    trajectory->poll();
+                if (capture)
+                    capture->poll(frame_sink);
+
+                if (window_settings.save_requested) {
+                    window_settings.save_requested = false;
+                    checkpoint();
+                }
+                if (window_settings.dump_requested) {
+                    window_settings.dump_requested = false;
+                    if (recorder)
+                        recorder->dump_ring();
+                }
+
                 if (window_settings.paused) {
-                    glfwPollEvents();
+                    // sleep until a key is pressed or it is time for the next report
+                    glfwWaitEventsTimeout(scheduler.idle_wait(glfwGetTime()));
+                    scheduler.reset();
                     continue;
                 }
 
-                // Clear the screen
-                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-                glClear(GL_COLOR_BUFFER_BIT);
-
                 // Run simulation
+                int steps = scheduler.steps_for_frame(glfwGetTime());
+                for (int i = 0; i < steps; i++)
+                    step(i == steps - 1);
+
+                if (checkpoint_every > 0 && step_count >= next_checkpoint) {
+                    if (next_checkpoint > 0)
+                        checkpoint();
+                    next_checkpoint = step_count + checkpoint_every;
+                }
+                if (series_recorder && step_count >= next_series) {
+                    record_series();
+                    next_series = step_count + series_every;
+                }
 
-                // run vertex and fragment shader
-                display->use();
-                glBindVertexArray(VAO);
-
-                glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-                glBindImageTexture(2, agent_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-
-                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, settingsSSBO);
-
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-                // run compute shader
-                compute->use();
-
-                glBindImageTexture(1, trail_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-                glBindImageTexture(2, agent_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
-
-                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, settingsSSBO);
-                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, agentSSBO);
-
-                const int compute_divisor = 256;
-                compute->dispatch(AGENT_COUNT / compute_divisor, 1);
-
-                glMemoryBarrier(GL_ALL_BARRIER_BITS);
+                present();
 
-                // Swap buffers
-                glfwSwapBuffers(simulation_window);
-                glfwPollEvents();
+                // wait out the rest of the frame if the frame rate is capped
+                double wait = scheduler.end_frame(glfwGetTime(), steps);
+                if (wait > 0)
+                    glfwWaitEventsTimeout(wait);
+                else
+                    glfwPollEvents();
             }
         }
 };
\ No newline at end of file
@@ -0,0 +1,331 @@
+#pragma once
+// defining some error constants inorder to find where the code is exiting upon error
+#define SNAPSHOT_LOAD_FAIL -10
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+    snapshot file format
+
+    description:
+        a snapshot holds everything needed to continue a run: the settings block, the agent buffer, the trail map
+        and the random number state (the seed and the step count, see rng.h)
+
+        the file is a header followed by the sections, every section starts on a 4096 byte boundary
+        so once the file is memory mapped each section can be handed straight to OpenGL without being parsed
+        every section has its own checksum, and the header has a checksum over itself
+
+        | snapshot_header | pad | settings | pad | agents | pad | trail |
+*/
+
+#define SNAPSHOT_MAGIC "SLIMSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ALIGNMENT 4096
+#define SNAPSHOT_ENDIAN_CHECK 0x01020304u
+
+struct snapshot_section {
+    uint64_t offset; // bytes from the start of the file
+    uint64_t size; // bytes in the section
+    uint64_t checksum; // snapshot_checksum of the section
+};
+
+struct snapshot_header {
+    char magic[8]; // SNAPSHOT_MAGIC, without the null terminator
+    uint32_t version; // SNAPSHOT_VERSION
+    uint32_t endian_check; // SNAPSHOT_ENDIAN_CHECK, written in the byte order of the machine that saved it
+    uint32_t header_size; // sizeof(snapshot_header), so a future version can grow the header
+
+    // the size of the simulation
+    int32_t width;
+    int32_t height;
+    int32_t agent_count;
+    uint32_t agent_size; // bytes per agent
+    uint32_t trail_format; // the internal format of the trail texture, GL_RGBA32F
+
+    // random number state
+    uint64_t seed;
+    uint64_t step;
+
+    snapshot_section settings;
+    snapshot_section agents;
+    snapshot_section trail;
+
+    uint64_t header_checksum; // snapshot_checksum of every byte above this one
+};
+
+/*
+    snapshot_checksum function
+
+    takes in a pointer to some bytes and the number of bytes
+    returns a 64 bit checksum of the bytes
+
+    description:
+        FNV-1a run over 8 byte words instead of single bytes, so hundreds of megabytes check quickly
+        the tail that doesn't fill a word is folded in byte by byte
+*/
+inline uint64_t snapshot_checksum(const void* data, size_t size) {
+    const uint64_t prime = 0x100000001B3ull;
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t word;
+        memcpy(&word, bytes + i * 8, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (size_t i = words * 8; i < size; i++)
+        hash = (hash ^ bytes[i]) * prime;
+
+    return hash;
+}
+
+inline uint64_t snapshot_align(uint64_t offset) {
+    return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+/*
+    make_snapshot_header function
+
+    takes in the sizes of the simulation and its random number state
+    returns a header with the sections laid out, the checksums are filled in by write_snapshot
+*/
+inline snapshot_header make_snapshot_header(int width, int height, int agent_count, uint32_t agent_size,
+    uint32_t settings_size, uint32_t trail_format, uint32_t trail_texel_size, uint64_t seed, uint64_t step) {
+    snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endian_check = SNAPSHOT_ENDIAN_CHECK;
+    header.header_size = sizeof(snapshot_header);
+
+    header.width = width;
+    header.height = height;
+    header.agent_count = agent_count;
+    header.agent_size = agent_size;
+    header.trail_format = trail_format;
+    header.seed = seed;
+    header.step = step;
+
+    header.settings.offset = snapshot_align(sizeof(snapshot_header));
+    header.settings.size = settings_size;
+    header.agents.offset = snapshot_align(header.settings.offset + header.settings.size);
+    header.agents.size = (uint64_t)agent_count * agent_size;
+    header.trail.offset = snapshot_align(header.agents.offset + header.agents.size);
+    header.trail.size = (uint64_t)width * height * trail_texel_size;
+    return header;
+}
+
+/*
+    replace_file function
+
+    takes in the path of a finished temporary file and the path it should end up at
+    returns true if the file was moved, replacing anything already at the path
+*/
+inline bool replace_file(const std::string& temp_path, const std::string& path) {
+#ifdef _WIN32
+    return MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0; // rename won't replace an existing file on windows
+#else
+    return rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+}
+
+/*
+    write_snapshot function
+
+    takes in the path, a header from make_snapshot_header and pointers to the three sections
+    returns true if the whole file was written
+
+    description:
+        fills in the checksums and writes the file next to the path first, then renames it over the path
+        so a crash in the middle of a save never destroys the previous snapshot
+*/
+inline bool write_snapshot(const std::string& path, snapshot_header header, const void* settings, const void* agents, const void* trail) {
+    header.settings.checksum = snapshot_checksum(settings, header.settings.size);
+    header.agents.checksum = snapshot_checksum(agents, header.agents.size);
+    header.trail.checksum = snapshot_checksum(trail, header.trail.size);
+    header.header_checksum = snapshot_checksum(&header, offsetof(snapshot_header, header_checksum));
+
+    std::string temp_path = path + ".tmp";
+    FILE* fout = fopen(temp_path.c_str(), "wb");
+    if (!fout) {
+        fprintf(stderr, "Could not open %s to write the snapshot.\n", temp_path.c_str());
+        return false;
+    }
+
+    // the sections are written in file order, padding with zeros up to each offset
+    const snapshot_section* sections[3] = { &header.settings, &header.agents, &header.trail };
+    const void* data[3] = { settings, agents, trail };
+    static const char padding[SNAPSHOT_ALIGNMENT] = {};
+
+    bool written = fwrite(&header, sizeof(header), 1, fout) == 1;
+    uint64_t position = sizeof(header);
+    for (int i = 0; i < 3 && written; i++) {
+        uint64_t pad = sections[i]->offset - position;
+        written = fwrite(padding, 1, (size_t)pad, fout) == pad;
+        written = written && fwrite(data[i], 1, (size_t)sections[i]->size, fout) == sections[i]->size;
+        position = sections[i]->offset + sections[i]->size;
+    }
+    written = (fclose(fout) == 0) && written;
+
+    if (!written) {
+        fprintf(stderr, "Could not write the snapshot to %s.\n", temp_path.c_str());
+        remove(temp_path.c_str());
+        return false;
+    }
+
+    if (!replace_file(temp_path, path)) {
+        fprintf(stderr, "Could not move the snapshot to %s.\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+    MappedSnapshot class
+
+    description:
+        memory maps a snapshot file read only and checks it
+        the section pointers point straight into the mapping, so they can be uploaded with no parsing or copying
+        the mapping is released when the object is destroyed
+
+    member variables:
+        data, size
+        header
+        (platform handles)
+*/
+class MappedSnapshot {
+    private:
+        const unsigned char* data = NULL; // the start of the mapping
+        uint64_t size = 0; // the size of the file
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = NULL;
+#endif
+
+        bool fail(const char* path, const char* reason) {
+            fprintf(stderr, "Could not load the snapshot %s: %s.\n", path, reason);
+            return false;
+        }
+
+        bool check_section(const snapshot_section& section) const {
+            return section.offset % SNAPSHOT_ALIGNMENT == 0 && section.offset <= size && section.size <= size - section.offset;
+        }
+
+    public:
+        const snapshot_header* header = NULL; // points at the start of the mapping once open succeeds
+
+        MappedSnapshot() {}
+        MappedSnapshot(const MappedSnapshot&) = delete;
+        MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+        ~MappedSnapshot() {
+#ifdef _WIN32
+            if (data)
+                UnmapViewOfFile(data);
+            if (mapping)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+#else
+            if (data)
+                munmap((void*)data, (size_t)size);
+#endif
+        }
+
+        /*
+            open function
+
+            takes in the path to the snapshot
+            returns true if the file was mapped and every check passed
+
+            description:
+                checks the magic, version, byte order, header checksum, section bounds and section checksums
+                the section checksums read the whole file once, nothing else is read before the upload
+        */
+        bool open(const char* path) {
+#ifdef _WIN32
+            file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+                return fail(path, "the file could not be opened");
+
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < (LONGLONG)sizeof(snapshot_header))
+                return fail(path, "the file is too small");
+            size = (uint64_t)file_size.QuadPart;
+
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping == NULL)
+                return fail(path, "the file could not be mapped");
+            data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (data == NULL)
+                return fail(path, "the file could not be mapped");
+#else
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0)
+                return fail(path, "the file could not be opened");
+
+            struct stat file_stat;
+            if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(snapshot_header)) {
+                close(fd);
+                return fail(path, "the file is too small");
+            }
+            size = (uint64_t)file_stat.st_size;
+
+            void* mapped = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapped == MAP_FAILED)
+                return fail(path, "the file could not be mapped");
+            data = (const unsigned char*)mapped;
+            madvise(mapped, (size_t)size, MADV_SEQUENTIAL);
+#endif
+
+            header = (const snapshot_header*)data;
+            if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+                return fail(path, "it is not a snapshot");
+            if (header->endian_check != SNAPSHOT_ENDIAN_CHECK)
+                return fail(path, "it was saved on a machine with a different byte order");
+            if (header->version != SNAPSHOT_VERSION || header->header_size != sizeof(snapshot_header))
+                return fail(path, "it was saved by a different version");
+            if (header->header_checksum != snapshot_checksum(header, offsetof(snapshot_header, header_checksum)))
+                return fail(path, "the header is corrupt");
+            if (!check_section(header->settings) || !check_section(header->agents) || !check_section(header->trail))
+                return fail(path, "the file is truncated");
+            if (header->agents.size != (uint64_t)header->agent_count * header->agent_size)
+                return fail(path, "the agent section doesn't match the agent count");
+
+            if (snapshot_checksum(settings(), header->settings.size) != header->settings.checksum)
+                return fail(path, "the settings are corrupt");
+            if (snapshot_checksum(agents(), header->agents.size) != header->agents.checksum)
+                return fail(path, "the agents are corrupt");
+            if (snapshot_checksum(trail(), header->trail.size) != header->trail.checksum)
+                return fail(path, "the trail map is corrupt");
+            return true;
+        }
+
+        const void* settings() const {
+            return data + header->settings.offset;
+        }
+        const void* agents() const {
+            return data + header->agents.offset;
+        }
+        const void* trail() const {
+            return data + header->trail.offset;
+        }
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+
+#include <cmath>
+#include <string>
+
+#include "rng.h"
+
+/*
+    spawn_agents function
+
+    takes in the agents to place (any struct with x, y and angle floats), how many there are, the spawn method,
+    the size of the map and the seed
+
+    description:
+        positions the agents based on the spawn method using the counter based random generator
+        the random words are made 8 agents at a time, each agent using its own id as the counter
+        the gpu simulation and the cpu engine both spawn through here, so the same seed places the agents the same way
+*/
+template <typename Agent>
+void spawn_agents(Agent* agents, int count, const std::string& spawn_method, int width, int height, uint64_t seed) {
+    const int lanes = 8;
+    philox_key key = make_philox_key(seed);
+
+    int center_x = width / 2;
+    int center_y = height / 2;
+
+    for (int first = 0; first < count; first += lanes) {
+        uint32_t random[4][lanes];
+        for (int lane = 0; lane < lanes; lane++) {
+            random[0][lane] = (uint32_t)(first + lane);
+            random[1][lane] = 0;
+            random[2][lane] = RNG_STREAM_SPAWN;
+            random[3][lane] = 0;
+        }
+        philox4x32_lanes<lanes>(random, key);
+
+        for (int lane = 0; lane < lanes && first + lane < count; lane++) {
+            Agent& current = agents[first + lane];
+            float angle = rng_unit(random[0][lane]) * 6.2831f;
+
+            if (spawn_method == "center") {
+                current.x = center_x;
+                current.y = center_y;
+                current.angle = rng_unit(random[0][lane]) * 12.5662f;
+            } else if (spawn_method == "random") {
+                current.x = (int)(rng_unit(random[1][lane]) * (width + 1));
+                current.y = (int)(rng_unit(random[2][lane]) * (height + 1));
+                current.angle = angle;
+            } else if (spawn_method == "circle") {
+                float radius = (int)(rng_unit(random[1][lane]) * ((width + height) / 10 + 1));
+                float spawn_angle = rng_unit(random[2][lane]) * 6.2831f;
+
+                current.angle = angle;
+                current.x = center_x + radius * cos(spawn_angle);
+                current.y = center_y + radius * sin(spawn_angle);
+            } else if (spawn_method == "ring") {
+                float radius = (width + height) / 10;
+                float spawn_angle = rng_unit(random[2][lane]) * 6.2831f;
+
+                current.angle = angle;
+                current.x = center_x + radius * cos(spawn_angle);
+                current.y = center_y + radius * sin(spawn_angle);
+            }
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <json.hpp>
+
+/*
+    species
+
+    description:
+        a run has 1 to MAX_SPECIES species of agents, every one with its own movement, sensors, decay and colour
+        all of them move in the one agent dispatch and diffuse in the one diffusion pass, the shaders look an agent's
+        parameters up in a small table (the species SSBO) instead of reading them from the settings
+
+        with one species the trail map holds that species' colour, the same as it always has
+        with more, every species owns one channel of the trail map and the display turns the channels into colours
+        the agents of a species are one block of ids, so the agent layout doesn't change and no agent carries its species
+
+        each species senses the trail through a row of the attraction matrix: the weight it gives every channel
+        a positive weight draws it towards that species' trail and a negative one pushes it away
+*/
+
+#define MAX_SPECIES 4 // one per channel of an RGBA texel
+
+// one entry of the species SSBO, laid out like species_struct in the shaders (std430)
+struct species_settings {
+    float move_speed;
+    float turn_speed;
+    float sensor_angle;
+    float sensor_distance;
+
+    float deposit[4]; // added to the trail map under an agent every step
+    float cap[4]; // the most trail a deposit can take the texel up to
+    float sense[4]; // the weight of each channel when sensing, a row of the attraction matrix
+    float color[4]; // the colour of the agents, and of the species' channel on the display
+
+    float decay_rate;
+    uint32_t first_agent; // the id of the species' first agent, the agents up to the next species' first are this species
+    float diffuse_rate; // only read per entry when the entries are dishes, see dishes.h
+    float padding;
+};
+
+/*
+    legacy_species function
+
+    takes in the agent settings, the colour (0 to 1), the decay rate and the diffuse rate of a single species run
+    returns the table entry that makes the shaders do what they did before there were species
+
+    description:
+        the agents deposit a fifth of their colour up to their colour, and sense the sum of all four channels
+*/
+inline species_settings legacy_species(float move_speed, float turn_speed, float sensor_angle, float sensor_distance,
+    float r, float g, float b, float decay_rate, float diffuse_rate) {
+    species_settings species = {};
+    species.move_speed = move_speed;
+    species.turn_speed = turn_speed;
+    species.sensor_angle = sensor_angle;
+    species.sensor_distance = sensor_distance;
+
+    float color[4] = { r, g, b, 1 };
+    for (int c = 0; c < 4; c++) {
+        species.deposit[c] = c == 3 ? 1.0f : color[c] / 5;
+        species.cap[c] = color[c];
+        species.sense[c] = 1;
+        species.color[c] = color[c];
+    }
+    species.decay_rate = decay_rate;
+    species.diffuse_rate = diffuse_rate;
+    species.first_agent = 0;
+    return species;
+}
+
+/*
+    read_species function
+
+    takes in the settings file, the table to fill and the total agent count to fill in
+    returns the number of species, 1 when the settings file has no species list
+
+    description:
+        every entry of "species" can set agent_count, color_r, color_g, color_b, move_speed, turn_speed, sensor_angle,
+        sensor_distance, decay_rate, deposit (how much trail an agent leaves a step) and attraction (a weight per species)
+        anything an entry leaves out comes from the top level settings, and a species is drawn to its own trail
+        and pushed away from the others unless its attraction says otherwise
+        with no list, the table is left empty for the caller to fill from its settings with legacy_species
+*/
+inline int read_species(const nlohmann::json& settings_file, std::vector<species_settings>& table, int& agent_count) {
+    table.clear();
+    if (!settings_file.contains("species") || settings_file["species"].size() < 2)
+        return 1;
+
+    const nlohmann::json& list = settings_file["species"];
+    int count = (int)std::min<size_t>(list.size(), MAX_SPECIES);
+    if ((int)list.size() > MAX_SPECIES)
+        fprintf(stderr, "Only the first %d species are run, one for each channel of the trail map.\n", MAX_SPECIES);
+
+    agent_count = 0;
+    for (int i = 0; i < count; i++) {
+        const nlohmann::json& entry = list[i];
+        species_settings species = {};
+        species.move_speed = entry.value("move_speed", settings_file["move_speed"].get<float>());
+        species.turn_speed = entry.value("turn_speed", settings_file["turn_speed"].get<float>());
+        species.sensor_angle = entry.value("sensor_angle", settings_file["sensor_angle"].get<float>());
+        species.sensor_distance = entry.value("sensor_distance", settings_file["sensor_distance"].get<float>());
+        species.decay_rate = entry.value("decay_rate", settings_file["decay_rate"].get<float>());
+        species.diffuse_rate = settings_file["diffuse_rate"].get<float>();
+
+        species.color[0] = entry.value("color_r", settings_file["color_r"].get<float>()) / 255.0f;
+        species.color[1] = entry.value("color_g", settings_file["color_g"].get<float>()) / 255.0f;
+        species.color[2] = entry.value("color_b", settings_file["color_b"].get<float>()) / 255.0f;
+        species.color[3] = 1;
+
+        std::vector<float> attraction = entry.value("attraction", std::vector<float>());
+        float deposit = entry.value("deposit", 0.2f);
+        for (int c = 0; c < 4; c++) {
+            species.deposit[c] = c == i ? deposit : 0.0f;
+            species.cap[c] = c == i ? 1.0f : 1e30f; // a deposit only ever raises its own channel
+            species.sense[c] = c < (int)attraction.size() ? attraction[c] : c >= count ? 0.0f : c == i ? 1.0f : -1.0f;
+        }
+
+        species.first_agent = (uint32_t)agent_count;
+        agent_count += entry.value("agent_count", settings_file["agent_count"].get<int>() / count);
+        table.push_back(species);
+    }
+    return count;
+}
+
+/*
+    species_color_matrix function
+
+    takes in the table, the number of species and a column major 4x4 matrix to fill
+    returns nothing, the matrix turns a texel of the trail map into the colour on the display
+
+    description:
+        with one species the trail map already holds the colour, so the matrix is the identity
+        with more, every channel is scaled by its species' colour
+*/
+inline void species_color_matrix(const std::vector<species_settings>& table, int count, float matrix[16]) {
+    for (int i = 0; i < 16; i++)
+        matrix[i] = i % 5 == 0 ? 1.0f : 0.0f;
+    if (count < 2)
+        return;
+
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++)
+            matrix[column * 4 + row] = column < count ? table[column].color[row] : 0.0f;
+    }
+}
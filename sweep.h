@@ -0,0 +1,425 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <json.hpp>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "cpu_engine.h"
+#include "image_files.h"
+#include "metrics.h"
+#include "pixels.h"
+#include "rng.h"
+#include "snapshot.h"
+
+/*
+    parameter sweeps
+
+    description:
+        runs the settings file many times on the cpu engine, each run with some of its settings changed, and writes
+        what every run ended up as to a results directory
+        the runs are handed to the cores one at a time from a shared counter, each on a single core
+        once there are no runs left to hand out, the cores that come free join the runs still going (the engine
+        spreads a step over its threads the same way), so a sweep doesn't wait on its last runs with the machine idle
+
+        every finished run leaves run_<index>.png (its final trail map) and run_<index>.json (its settings and metrics)
+        the json is written last and moved into place, so a run is finished exactly when its json is there
+        a sweep that is stopped and started again skips the runs that finished, and index.csv lists every finished run
+*/
+
+// a setting of engine_settings that sweeps can vary, by its name in settings.json
+struct sweep_parameter {
+    const char* name;
+    float engine_settings::* field;
+};
+
+/*
+    sweep_parameters function
+
+    returns the settings a sweep can vary
+*/
+inline const std::vector<sweep_parameter>& sweep_parameters() {
+    static const std::vector<sweep_parameter> parameters = {
+        { "move_speed", &engine_settings::move_speed },
+        { "turn_speed", &engine_settings::turn_speed },
+        { "sensor_angle", &engine_settings::sensor_angle },
+        { "sensor_distance", &engine_settings::sensor_distance },
+        { "decay_rate", &engine_settings::decay_rate },
+        { "diffuse_rate", &engine_settings::diffuse_rate },
+    };
+    return parameters;
+}
+
+/*
+    find_sweep_parameter function
+
+    takes in the name of a setting
+    returns the setting, NULL if a sweep can't vary it
+*/
+inline const sweep_parameter* find_sweep_parameter(const std::string& name) {
+    for (const sweep_parameter& parameter : sweep_parameters()) {
+        if (name == parameter.name)
+            return &parameter;
+    }
+    return NULL;
+}
+
+// one run of a sweep
+struct sweep_job {
+    int index; // the number in the run's file names
+    uint64_t seed;
+    std::vector<float> values; // a value for each of the sweep's parameters, in the same order
+};
+
+// everything a sweep file asks for
+struct sweep_spec {
+    std::vector<const sweep_parameter*> parameters;
+    std::vector<sweep_job> jobs;
+    int steps; // the steps every run takes
+    std::string results; // the directory the results go to
+};
+
+/*
+    read_sweep function
+
+    takes in the path to the sweep file and the spec to fill in
+    returns true if the file was read
+
+    description:
+        the sweep file sets "steps", "results", "seed" and "repeats" and then either
+            "grid" - a list of values for each setting, every combination is run
+            "random" - a "samples" count and a [low, high] range for each setting, the values are drawn uniformly
+        every point is run "repeats" times, with the seeds seed, seed + 1 and so on
+        the random values come from the counter based generator, so the same file always makes the same runs
+        the file is read keeping its key order, so the settings come in the order the file lists them
+*/
+inline bool read_sweep(const char* path, sweep_spec& spec) {
+    std::ifstream fin(path);
+    if (!fin) {
+        fprintf(stderr, "Could not load the sweep file %s.\n", path);
+        return false;
+    }
+
+    nlohmann::ordered_json sweep_file;
+    fin >> sweep_file;
+
+    spec.steps = std::max(1, sweep_file.value("steps", 1000));
+    spec.results = sweep_file.value("results", std::string("./sweep"));
+    uint64_t seed = sweep_file.value("seed", (uint64_t)1);
+    int repeats = std::max(1, sweep_file.value("repeats", 1));
+
+    bool grid = sweep_file.contains("grid");
+    nlohmann::ordered_json axes = grid ? sweep_file["grid"] :
+        sweep_file.value("random", nlohmann::ordered_json::object()).value("ranges", nlohmann::ordered_json::object());
+    if (!axes.is_object() || axes.empty()) {
+        fprintf(stderr, "The sweep file needs a \"grid\" or a \"random\" with \"ranges\".\n");
+        return false;
+    }
+
+    spec.parameters.clear();
+    std::vector<std::vector<float>> lists;
+    for (auto axis = axes.begin(); axis != axes.end(); ++axis) {
+        const sweep_parameter* parameter = find_sweep_parameter(axis.key());
+        std::vector<float> list = axis.value().get<std::vector<float>>();
+        if (!parameter || list.empty() || (!grid && list.size() != 2)) {
+            fprintf(stderr, "The sweep can't vary %s like that, it is left out.\n", axis.key().c_str());
+            continue;
+        }
+        spec.parameters.push_back(parameter);
+        lists.push_back(list);
+    }
+
+    // the points of the grid are counted off with the last setting in the file changing fastest
+    std::vector<std::vector<float>> points;
+    if (grid) {
+        int count = 1;
+        for (const std::vector<float>& list : lists)
+            count *= (int)list.size();
+        for (int point = 0; point < count && !lists.empty(); point++) {
+            std::vector<float> values(lists.size());
+            for (int axis = (int)lists.size() - 1, rest = point; axis >= 0; axis--) {
+                values[axis] = lists[axis][rest % lists[axis].size()];
+                rest /= (int)lists[axis].size();
+            }
+            points.push_back(values);
+        }
+    } else {
+        philox_key key = make_philox_key(seed);
+        int samples = sweep_file["random"].value("samples", 16);
+        for (int sample = 0; sample < samples; sample++) {
+            std::vector<float> values(lists.size());
+            for (size_t axis = 0; axis < lists.size(); axis++) {
+                uint32_t random[4] = { (uint32_t)sample, (uint32_t)axis, RNG_STREAM_SWEEP, 0 };
+                philox4x32(random, key);
+                values[axis] = lists[axis][0] + (lists[axis][1] - lists[axis][0]) * rng_unit(random[0]);
+            }
+            points.push_back(values);
+        }
+    }
+
+    spec.jobs.clear();
+    for (size_t point = 0; point < points.size(); point++) {
+        for (int repeat = 0; repeat < repeats; repeat++)
+            spec.jobs.push_back({ (int)spec.jobs.size(), seed + repeat, points[point] });
+    }
+    return !spec.jobs.empty();
+}
+
+/*
+    sweep_path function
+
+    takes in the spec, the index of a run and the file extension
+    returns the path of that run's file in the results directory
+*/
+inline std::string sweep_path(const sweep_spec& spec, int index, const char* extension) {
+    char name[32];
+    snprintf(name, sizeof(name), "run_%05d.%s", index, extension);
+    return spec.results + "/" + name;
+}
+
+/*
+    write_sweep_file function
+
+    takes in the path and the bytes to write
+    returns true if the file was written
+
+    description:
+        writes next to the path and moves it over, so a file in the results directory is never half written
+*/
+inline bool write_sweep_file(const std::string& path, const void* data, size_t size) {
+    std::string temp_path = path + ".tmp";
+    FILE* fout = fopen(temp_path.c_str(), "wb");
+    if (!fout) {
+        fprintf(stderr, "Could not open %s to write.\n", temp_path.c_str());
+        return false;
+    }
+    bool written = fwrite(data, 1, size, fout) == size;
+    written = (fclose(fout) == 0) && written;
+    if (!written || !replace_file(temp_path, path)) {
+        fprintf(stderr, "Could not write %s.\n", path.c_str());
+        remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+    make_results_directory function
+
+    takes in the path of the directory
+    returns nothing, the directory is made if it isn't there already
+*/
+inline void make_results_directory(const std::string& path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+/*
+    sweep_base_checksum function
+
+    takes in the base run and the spec
+    returns a checksum of every setting of the base run that the sweep doesn't vary
+
+    description:
+        written into every run's json, so a sweep started again after settings.json changed runs everything again
+        instead of mixing runs of the old settings in with the new ones
+*/
+inline uint64_t sweep_base_checksum(const engine_run& base, const sweep_spec& spec) {
+    nlohmann::json settings;
+    for (const sweep_parameter& parameter : sweep_parameters()) {
+        if (std::find(spec.parameters.begin(), spec.parameters.end(), &parameter) == spec.parameters.end())
+            settings[parameter.name] = base.settings.*(parameter.field);
+    }
+    settings["map_width"] = base.settings.width;
+    settings["map_height"] = base.settings.height;
+    settings["color"] = { base.settings.r, base.settings.g, base.settings.b };
+    settings["agent_count"] = base.agent_count;
+    settings["spawn_method"] = base.spawn_method;
+    settings["boundary"] = base.kernels.boundary_mode;
+    settings["sensor_size"] = base.kernels.sensor_size;
+    settings["trail_precision"] = base.kernels.trail_precision;
+
+    // the keys come out sorted, so the same settings always give the same text
+    std::string text = settings.dump();
+    return snapshot_checksum(text.data(), text.size());
+}
+
+/*
+    read_sweep_result function
+
+    takes in the spec, a run, the checksum of the base run (see sweep_base_checksum) and the json to fill with the run's result
+    returns true if the run already finished with the same settings and seed
+*/
+inline bool read_sweep_result(const sweep_spec& spec, const sweep_job& job, uint64_t base_checksum, nlohmann::json& result) {
+    std::ifstream fin(sweep_path(spec, job.index, "json"));
+    if (!fin)
+        return false;
+
+    result = nlohmann::json::parse(fin, nullptr, false);
+    if (result.is_discarded() || result.value("seed", (uint64_t)0) != job.seed || result.value("steps", 0) != spec.steps ||
+        result.value("base_checksum", (uint64_t)0) != base_checksum)
+        return false;
+    for (size_t i = 0; i < spec.parameters.size(); i++) {
+        const nlohmann::json& parameters = result["parameters"];
+        if (!parameters.contains(spec.parameters[i]->name) || parameters[spec.parameters[i]->name].get<float>() != job.values[i])
+            return false;
+    }
+    return true;
+}
+
+/*
+    run_sweep_job function
+
+    takes in the base run, the spec, the run to do and the number of runs still going (this one included)
+    returns true if the run's results were written
+
+    description:
+        every step the run takes its share of the threads, so it speeds up as the other runs finish
+*/
+inline bool run_sweep_job(const engine_run& base, const sweep_spec& spec, const sweep_job& job, int threads, const std::atomic<int>& running) {
+    engine_run run = base;
+    run.seed = job.seed;
+    philox_key key = make_philox_key(job.seed);
+    run.settings.seed_lo = key.k0;
+    run.settings.seed_hi = key.k1;
+    for (size_t i = 0; i < spec.parameters.size(); i++)
+        run.settings.*(spec.parameters[i]->field) = job.values[i];
+    run.threads = 1;
+
+    auto start = std::chrono::steady_clock::now();
+    Engine* engine = make_engine(run);
+    for (int i = 0; i < spec.steps; i++) {
+        engine->set_threads(std::max(1, threads / std::max(1, running.load())));
+        engine->step(false);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int width = run.settings.width;
+    int height = run.settings.height;
+    std::vector<float> trail((size_t)width * height * 4);
+    engine->read_trail(trail.data());
+    delete engine;
+    trail_metrics metrics = measure_trail(trail.data(), width, height);
+
+    std::vector<uint8_t> rgb((size_t)width * height * 3);
+    std::vector<uint8_t> png;
+    float_rows_to_rgb8(trail.data(), width, height, rgb.data());
+    encode_png(rgb.data(), width, height, png);
+    if (!write_sweep_file(sweep_path(spec, job.index, "png"), png.data(), png.size()))
+        return false;
+
+    nlohmann::ordered_json result;
+    result["index"] = job.index;
+    result["seed"] = job.seed;
+    result["steps"] = spec.steps;
+    result["base_checksum"] = sweep_base_checksum(base, spec);
+    for (size_t i = 0; i < spec.parameters.size(); i++)
+        result["parameters"][spec.parameters[i]->name] = job.values[i];
+    for (const trail_metric& metric : trail_metric_list())
+        result["metrics"][metric.name] = metrics.*(metric.field);
+    result["seconds"] = seconds;
+    std::string text = result.dump(2);
+    return write_sweep_file(sweep_path(spec, job.index, "json"), text.data(), text.size());
+}
+
+/*
+    write_sweep_index function
+
+    takes in the spec and the checksum of the base run
+    returns true if index.csv was written
+
+    description:
+        one line for every finished run, in index order, made from the runs' json files
+*/
+inline bool write_sweep_index(const sweep_spec& spec, uint64_t base_checksum) {
+    std::string csv = "index,seed";
+    for (const sweep_parameter* parameter : spec.parameters)
+        csv += std::string(",") + parameter->name;
+    csv += ",mean,deviation,coverage,edges,seconds\n";
+
+    for (const sweep_job& job : spec.jobs) {
+        nlohmann::json result;
+        if (!read_sweep_result(spec, job, base_checksum, result))
+            continue;
+
+        char line[64];
+        csv += std::to_string(job.index) + "," + std::to_string(job.seed);
+        for (float value : job.values) {
+            snprintf(line, sizeof(line), ",%g", value);
+            csv += line;
+        }
+        const nlohmann::json& metrics = result["metrics"];
+        snprintf(line, sizeof(line), ",%g,%g,%g,%g", metrics["mean"].get<float>(), metrics["deviation"].get<float>(),
+            metrics["coverage"].get<float>(), metrics["edges"].get<float>());
+        csv += line;
+        snprintf(line, sizeof(line), ",%.3f\n", result["seconds"].get<double>());
+        csv += line;
+    }
+    return write_sweep_file(spec.results + "/index.csv", csv.data(), csv.size());
+}
+
+/*
+    run_sweep function
+
+    takes in the base run read from the settings file and the spec
+    returns true if every run finished
+
+    description:
+        makes the results directory, skips the runs that already finished and runs the rest over base.threads cores
+*/
+inline bool run_sweep(const engine_run& base, const sweep_spec& spec) {
+    make_results_directory(spec.results);
+
+    uint64_t base_checksum = sweep_base_checksum(base, spec);
+    std::vector<const sweep_job*> todo;
+    int changed = 0;
+    for (const sweep_job& job : spec.jobs) {
+        nlohmann::json result;
+        if (read_sweep_result(spec, job, base_checksum, result))
+            continue;
+        todo.push_back(&job);
+        if (result.is_object() && result.value("seed", (uint64_t)0) == job.seed && result.value("base_checksum", (uint64_t)0) != base_checksum)
+            changed++;
+    }
+    if (changed > 0)
+        fprintf(stderr, "%d runs finished with other settings than settings.json has now, they are run again.\n", changed);
+    fprintf(stderr, "%d of %d runs finished already, %d to go.\n", (int)(spec.jobs.size() - todo.size()), (int)spec.jobs.size(), (int)todo.size());
+
+    int threads = base.threads > 0 ? base.threads : (int)std::thread::hardware_concurrency();
+    int workers = std::max(1, std::min(threads, (int)todo.size()));
+    std::atomic<int> next(0), running(workers), done(0), failed(0);
+    auto work = [&]() {
+        for (int i = next++; i < (int)todo.size(); i = next++) {
+            if (!run_sweep_job(base, spec, *todo[i], threads, running))
+                failed++;
+            fprintf(stderr, "run %d done, %d of %d\n", todo[i]->index, ++done, (int)todo.size());
+        }
+        // this core is free for the runs still going
+        running--;
+    };
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < workers; i++)
+        helpers.emplace_back(work);
+    work();
+    for (std::thread& helper : helpers)
+        helper.join();
+
+    return write_sweep_index(spec, base_checksum) && failed == 0;
+}
@@ -0,0 +1,300 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define GLEW_STATIC
+#include <glew.h>
+
+#include "readback.h"
+#include "shader.h"
+#include "snapshot.h"
+
+/*
+    trajectory file format
+
+    description:
+        a trajectory_header, then one trajectory_record for every followed agent for every recorded step,
+        in step order and in the order of the ids within a step
+        the records are streamed as they come back from the gpu, so a file cut short by a crash still reads up to the cut
+
+        | trajectory_header | record | record | ...
+*/
+
+#define TRAJECTORY_MAGIC "SLIMTRAJ"
+#define TRAJECTORY_VERSION 1
+
+struct trajectory_header {
+    char magic[8]; // TRAJECTORY_MAGIC, without the null terminator
+    uint32_t version; // TRAJECTORY_VERSION
+    uint32_t endian_check; // SNAPSHOT_ENDIAN_CHECK
+    uint32_t header_size; // sizeof(trajectory_header)
+    uint32_t record_size; // sizeof(trajectory_record)
+    uint32_t probe_count; // records per step
+    uint32_t reserved;
+    uint64_t seed;
+};
+
+// the same layout as trajectory_record in trajectory.glsl
+struct trajectory_record {
+    uint32_t step;
+    uint32_t id;
+    float x;
+    float y;
+    float heading;
+};
+
+/*
+    TrajectoryProbe class
+
+    description:
+        follows a few agents without ever reading the whole agent buffer back
+        every recorded step a compute shader gathers the followed agents into the next row of a batch,
+        and the batch is a persistently mapped buffer, so the records land where the cpu can read them with no copies
+        once a batch holds batch_steps rows a fence is placed after it and the next batch is started,
+        when the fence signals the batch is handed to a writer thread that streams it to the file
+        the batches are handed over in the order they were filled, so the file stays in step order whichever batch
+        the next rows went into
+
+        if the writer falls so far behind that every batch is still busy, the steps are dropped and counted
+        instead of waiting on the gpu or the disk
+
+    member variables:
+        shader
+        ids, probe_count, batch_steps
+        batches, current, fenced
+        output, path, write_failed
+        queue, queue_lock, queue_signal, writer, stopping
+        dropped
+*/
+class TrajectoryProbe {
+    private:
+        enum batch_state {
+            BATCH_FREE, // ready to be filled
+            BATCH_FILLING, // the gl thread is adding rows
+            BATCH_PENDING, // full, waiting on its fence
+            BATCH_WRITING // owned by the writer thread until it is written
+        };
+
+        struct batch {
+            std::atomic<int> state{ BATCH_FREE };
+            GLsync fence = 0;
+            ReadbackBuffer records; // batch_steps rows of probe_count records
+            uint32_t rows = 0; // the rows filled
+        };
+
+        static const int batch_count = 3;
+
+        ComputeShader shader;
+        GLuint ids = 0; // the ids of the followed agents
+        uint32_t probe_count = 0;
+        uint32_t batch_steps; // the steps gathered before a batch is read back
+
+        batch batches[batch_count];
+        batch* current = NULL; // the batch being filled, if any
+        std::deque<batch*> fenced; // full batches waiting on their fence, oldest first
+
+        FILE* output = NULL;
+        std::string path;
+        std::atomic<bool> write_failed{ false }; // set by the writer when the file can't be written anymore
+
+        std::deque<batch*> queue; // batches waiting for the writer
+        std::mutex queue_lock;
+        std::condition_variable queue_signal;
+        std::thread writer;
+        bool stopping = false;
+
+        long long dropped = 0; // steps dropped because every batch was busy
+
+        /*
+            write_loop function
+
+            description:
+                the writer thread, streams every batch that shows up in the queue and frees it again
+        */
+        void write_loop() {
+            while (true) {
+                batch* written;
+                {
+                    std::unique_lock<std::mutex> lock(queue_lock);
+                    queue_signal.wait(lock, [this] { return stopping || !queue.empty(); });
+                    if (queue.empty())
+                        return;
+                    written = queue.front();
+                    queue.pop_front();
+                }
+
+                size_t count = (size_t)written->rows * probe_count;
+                if (!write_failed && fwrite(written->records.mapped, sizeof(trajectory_record), count, output) != count) {
+                    fprintf(stderr, "Could not write to %s, the trajectories stop here.\n", path.c_str());
+                    write_failed = true;
+                }
+                written->rows = 0;
+                written->state = BATCH_FREE;
+            }
+        }
+
+        /*
+            finish_batch function
+
+            description:
+                fences the current batch so poll can hand it to the writer once the gpu is done with it
+        */
+        void finish_batch() {
+            glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+            // the fence is polled without flushing, so it is flushed here or it may never reach the gpu
+            current->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            current->state = BATCH_PENDING;
+            fenced.push_back(current);
+            current = NULL;
+        }
+
+    public:
+        /*
+            TrajectoryProbe contructor
+
+            takes in the ids to follow, the agent count, the steps per batch, the path and the seed
+
+            description:
+                ids past the agent count are left out
+                has to run on the gl thread
+        */
+        TrajectoryProbe(const std::vector<uint32_t>& agent_ids, int agent_count, int steps, const std::string& file_path, uint64_t seed) :
+            shader("./shaders/trajectory.glsl"), batch_steps(steps > 0 ? steps : 1), path(file_path) {
+            std::vector<uint32_t> valid;
+            for (uint32_t id : agent_ids) {
+                if (id < (uint32_t)agent_count)
+                    valid.push_back(id);
+            }
+            probe_count = (uint32_t)valid.size();
+
+            glCreateBuffers(1, &ids);
+            glNamedBufferStorage(ids, std::max<size_t>(valid.size(), 1) * sizeof(uint32_t), valid.empty() ? NULL : valid.data(), 0);
+            for (int i = 0; i < batch_count; i++)
+                batches[i].records.reserve(std::max<size_t>((size_t)batch_steps * probe_count, 1) * sizeof(trajectory_record));
+
+            output = fopen(path.c_str(), "wb");
+            if (!output) {
+                fprintf(stderr, "Could not open %s to write the trajectories.\n", path.c_str());
+            } else {
+                trajectory_header header;
+                memset(&header, 0, sizeof(header));
+                memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+                header.version = TRAJECTORY_VERSION;
+                header.endian_check = SNAPSHOT_ENDIAN_CHECK;
+                header.header_size = sizeof(trajectory_header);
+                header.record_size = sizeof(trajectory_record);
+                header.probe_count = probe_count;
+                header.seed = seed;
+                fwrite(&header, sizeof(header), 1, output);
+            }
+            writer = std::thread(&TrajectoryProbe::write_loop, this);
+        }
+
+        TrajectoryProbe(const TrajectoryProbe&) = delete;
+        TrajectoryProbe& operator=(const TrajectoryProbe&) = delete;
+
+        /*
+            TrajectoryProbe destructor
+
+            description:
+                writes every row recorded so far, including the batch that isn't full yet
+                this has to run on the gl thread while the context is still current
+        */
+        ~TrajectoryProbe() {
+            if (current)
+                finish_batch();
+            for (batch* pending : fenced)
+                glClientWaitSync(pending->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+            poll();
+
+            {
+                std::lock_guard<std::mutex> lock(queue_lock);
+                stopping = true;
+            }
+            queue_signal.notify_one();
+            writer.join();
+
+            if (output)
+                fclose(output);
+            if (dropped > 0)
+                fprintf(stderr, "The trajectory probe dropped %lld steps.\n", dropped);
+
+            for (int i = 0; i < batch_count; i++)
+                batches[i].records.release();
+            glDeleteBuffers(1, &ids);
+            glDeleteProgram(shader.program_id);
+        }
+
+        /*
+            record function
+
+            takes in the agent buffer and the step the simulation is on
+
+            description:
+                gathers the followed agents into the next row of the current batch
+                the caller makes sure the step's writes to the agents are visible first
+        */
+        void record(GLuint agent_buffer, uint32_t step) {
+            if (probe_count == 0 || !output || write_failed)
+                return;
+
+            if (current == NULL) {
+                for (int i = 0; i < batch_count && current == NULL; i++) {
+                    if (batches[i].state == BATCH_FREE)
+                        current = &batches[i];
+                }
+                if (current == NULL) {
+                    dropped++;
+                    return;
+                }
+                current->state = BATCH_FILLING;
+            }
+
+            shader.use();
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, agent_buffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, ids);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, current->records.buffer);
+            shader.set_uint("probe_count", probe_count);
+            shader.set_uint("row", current->rows);
+            shader.set_uint("step_index", step);
+            shader.dispatch((probe_count + 255) / 256, 1);
+
+            if (++current->rows == batch_steps)
+                finish_batch();
+        }
+
+        /*
+            poll function
+
+            description:
+                hands the batches whose fences have signaled to the writer thread, oldest first, never blocks
+                a batch is only handed over once every batch filled before it has been, so the rows reach the file in step order
+                called once per loop iteration on the gl thread
+        */
+        void poll() {
+            while (!fenced.empty() && fence_signaled(fenced.front()->fence)) {
+                batch* pending = fenced.front();
+                fenced.pop_front();
+
+                glDeleteSync(pending->fence);
+                pending->fence = 0;
+                pending->state = BATCH_WRITING;
+                {
+                    std::lock_guard<std::mutex> lock(queue_lock);
+                    queue.push_back(pending);
+                }
+                queue_signal.notify_one();
+            }
+        }
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "capture.h"
+#include "pixels.h"
+
+// the formats the video sink writes
+#define VIDEO_Y4M 0 // YUV4MPEG2, 4:2:0, any encoder can read it with no extra flags
+#define VIDEO_RAW 1 // headerless rgb24 frames, needs -f rawvideo -pix_fmt rgb24 -s WxH on the ffmpeg side
+
+// what the sink does with a new frame when its queue is full
+#define DROP_OLDEST 0 // release the oldest queued frame and keep the new one
+#define DROP_NEWEST 1 // release the new frame and keep the queue
+
+/*
+    VideoSink class
+
+    description:
+        a FrameSink that streams captured frames into a single video file, or into stdout when the path is "-"
+        so a local encoder can be fed while the simulation keeps going, for example
+            driver | ffmpeg -i - out.mp4
+
+        the gl thread only queues the frame leases, a worker thread converts each frame from the mapped pixels,
+        releases the lease as soon as the conversion is done and then writes the converted frame out
+        the queue is bounded, when the encoder falls behind frames are dropped by the drop policy
+        instead of ever blocking the gl thread
+
+    member variables:
+        format, drop_policy, frame_rate
+        output, output_path
+        width, height
+        queue, queue_capacity, queue_lock, queue_signal
+        worker, stopping
+        written, dropped
+*/
+class VideoSink : public FrameSink {
+    private:
+        int format; // VIDEO_Y4M or VIDEO_RAW
+        int drop_policy; // DROP_OLDEST or DROP_NEWEST
+        int frame_rate; // the frame rate written in the y4m header
+        FILE* output = NULL;
+        std::string output_path;
+
+        // every frame has to be the size of the first one
+        int width = 0;
+        int height = 0;
+
+        std::deque<CaptureFrame> queue; // leases waiting for the worker
+        size_t queue_capacity;
+        std::mutex queue_lock;
+        std::condition_variable queue_signal;
+        std::thread worker;
+        bool stopping = false;
+
+        long long written = 0; // frames written, only touched by the worker
+        long long dropped = 0; // frames dropped by the policy or for changing size, guarded by queue_lock
+
+        /*
+            write_loop function
+
+            description:
+                the worker thread, converts and writes every frame that shows up in the queue
+        */
+        void write_loop() {
+            std::vector<uint8_t> rgb, yuv;
+            while (true) {
+                CaptureFrame frame;
+                {
+                    std::unique_lock<std::mutex> lock(queue_lock);
+                    queue_signal.wait(lock, [this] { return stopping || !queue.empty(); });
+                    if (queue.empty())
+                        return;
+                    frame = queue.front();
+                    queue.pop_front();
+                }
+
+                // convert straight out of the mapped buffer, then give the buffer back before the slow write
+                rgb.resize((size_t)frame.width * frame.height * 3);
+                if (frame.is_float)
+                    float_rows_to_rgb8((const float*)frame.pixels, frame.width, frame.height, rgb.data());
+                else
+                    byte_rows_to_rgb8((const uint8_t*)frame.pixels, frame.width, frame.height, rgb.data());
+                frame.release();
+
+                const uint8_t* out = rgb.data();
+                size_t out_size = rgb.size();
+                if (format == VIDEO_Y4M) {
+                    size_t luma = (size_t)frame.width * frame.height;
+                    size_t chroma = (size_t)((frame.width + 1) / 2) * ((frame.height + 1) / 2);
+                    yuv.resize(luma + 2 * chroma);
+                    rgb8_to_yuv420(rgb.data(), frame.width, frame.height, yuv.data(), yuv.data() + luma, yuv.data() + luma + chroma);
+                    out = yuv.data();
+                    out_size = yuv.size();
+
+                    if (written == 0)
+                        fprintf(output, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", frame.width, frame.height, frame_rate);
+                    fputs("FRAME\n", output);
+                }
+
+                if (fwrite(out, 1, out_size, output) != out_size) {
+                    fprintf(stderr, "Could not write to %s, the video stops here.\n", output_path.c_str());
+                    std::lock_guard<std::mutex> lock(queue_lock);
+                    stopping = true;
+                    for (const CaptureFrame& queued : queue)
+                        queued.release();
+                    queue.clear();
+                    return;
+                }
+                written++;
+            }
+        }
+
+    public:
+        /*
+            VideoSink contructor
+
+            takes in the path ("-" for stdout), the format, the frame rate, the queue size and the drop policy
+
+            description:
+                opens the output and starts the worker thread
+                if the output can't be opened every frame is dropped
+        */
+        VideoSink(const std::string& path, int video_format, int rate, int capacity, int policy) :
+            format(video_format), drop_policy(policy), frame_rate(rate > 0 ? rate : 60), output_path(path) {
+            queue_capacity = capacity > 0 ? capacity : 1;
+
+            if (path == "-") {
+#ifdef _WIN32
+                _setmode(_fileno(stdout), _O_BINARY);
+#endif
+                output = stdout;
+            } else {
+                output = fopen(path.c_str(), "wb");
+            }
+
+            if (!output) {
+                fprintf(stderr, "Could not open %s to write the video.\n", path.c_str());
+                stopping = true;
+                return;
+            }
+            worker = std::thread(&VideoSink::write_loop, this);
+        }
+
+        /*
+            VideoSink destructor
+
+            description:
+                writes everything still queued, then closes the output
+        */
+        ~VideoSink() {
+            {
+                std::lock_guard<std::mutex> lock(queue_lock);
+                stopping = true;
+            }
+            queue_signal.notify_one();
+            if (worker.joinable())
+                worker.join();
+
+            if (output && output != stdout)
+                fclose(output);
+            else if (output)
+                fflush(output);
+
+            if (dropped > 0)
+                fprintf(stderr, "The video sink dropped %lld frames and wrote %lld.\n", dropped, written);
+        }
+
+        /*
+            consume function
+
+            takes in a captured frame
+
+            description:
+                only queues the frame, when the queue is full the drop policy decides which frame is released
+        */
+        void consume(const CaptureFrame& frame) override {
+            std::unique_lock<std::mutex> lock(queue_lock);
+            if (stopping || !output) {
+                frame.release();
+                return;
+            }
+
+            // a video can't change size, so frames after a resize are dropped
+            if (width == 0) {
+                width = frame.width;
+                height = frame.height;
+            }
+            if (frame.width != width || frame.height != height) {
+                frame.release();
+                dropped++;
+                return;
+            }
+
+            if (queue.size() >= queue_capacity) {
+                dropped++;
+                if (drop_policy == DROP_NEWEST) {
+                    frame.release();
+                    return;
+                }
+                queue.front().release();
+                queue.pop_front();
+            }
+
+            queue.push_back(frame);
+            lock.unlock();
+            queue_signal.notify_one();
+        }
+};